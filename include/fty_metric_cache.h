@@ -27,6 +27,13 @@
 
 //  Add your own public definitions here, if you need them
 #define FTY_METRIC_CACHE_MAILBOX "fty-metric-cache"
+#define FTY_METRIC_CACHE_SERVICE "fty-metric-cache"
+
+//  First frame of batch of metrics of one element, published on METRICS
+//  stream or pushed to PULL endpoint instead of fty_proto METRIC messages:
+//      METRIC-BATCH/name/time/(type/value/unit/ttl)^i
+//  where '/' indicates a multipart string message and 'time' 0 means now
+#define FTY_METRIC_CACHE_BATCH "METRIC-BATCH"
 #define LOG_CONFIG "/etc/fty/ftylog.cfg"
 
 #endif
@@ -29,6 +29,27 @@ extern "C" {
 //  @interface
 
 //  FTY metric cache server
+//  Requests for a service registered by WORKER command are answered like
+//  mailbox requests (see mailbox.h). Besides actor commands (see
+//  actor_commands.h) it handles
+//
+//  SCHEDULE/budget/limit
+//      store queued metrics for at most 'budget' ms per wakeup, keeping at
+//      most 'limit' of them queued (default 10 ms and 10000). Over the limit,
+//      each received metric has the oldest queued one stored at once, out of
+//      budget, so requests are still received but ingest costs them time
+//      again; this is logged with the periodic report.
+//
+//  ROUTER/endpoint
+//      answer requests of the mailbox protocol (see mailbox.h) sent by DEALER
+//      peers directly to ROUTER socket bound to 'endpoint' (e.g. ipc://...),
+//      bypassing malamute; many requests may be outstanding, replies come in
+//      order. Empty endpoint closes the socket.
+//
+//  PULL/endpoint
+//      store fty_proto messages (METRIC, or ASSET when consuming assets)
+//      pushed by PUSH peers directly to PULL socket bound to 'endpoint',
+//      like those of the METRICS stream. Empty endpoint closes the socket.
 FTY_METRIC_CACHE_EXPORT void
     fty_metric_cache_server (zsock_t *pipe, void *args);
 
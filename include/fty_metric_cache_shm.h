@@ -0,0 +1,218 @@
+/*  =========================================================================
+    fty_metric_cache_shm - Read-only view of the cache in shared memory
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+    The agent started with option --shm (or actor command VIEW) keeps copy
+    of its metrics in POSIX shared memory object, so that processes on the
+    same machine can read them without any messaging or system call per
+    read. This header is all a reader needs:
+
+        fty_metric_cache_shm_t shm;
+        if (fty_metric_cache_shm_open (&shm, FTY_METRIC_CACHE_SHM_NAME) == 0) {
+            fty_metric_cache_shm_record_t record;
+            if (fty_metric_cache_shm_get (&shm, "ups-1", "realpower.default", &record) == 0)
+                printf ("%s %s\n", record.value, record.unit);
+            fty_metric_cache_shm_close (&shm);
+        }
+
+    The object starts with a header followed by a fixed number of records,
+    a hash table of (element, type) with linear probing. Each record is
+    guarded by a sequence lock: its sequence is odd while the agent writes
+    it, a reader copies the record and retries when the sequence changed
+    meanwhile. Removing a record shifts the records probed after it back
+    towards their home slot, so the table never fills up with tombstones;
+    the header counter 'moves' is odd while that happens and a lookup that
+    saw it change starts over. Expired metrics stay in the table until the agent purges
+    them (every 30 seconds), readers compare time + ttl with current time.
+*/
+
+#ifndef FTY_METRIC_CACHE_SHM_H_INCLUDED
+#define FTY_METRIC_CACHE_SHM_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  Name of the object unless configured otherwise
+#define FTY_METRIC_CACHE_SHM_NAME     "/fty-metric-cache"
+
+#define FTY_METRIC_CACHE_SHM_MAGIC    0x464d4331  // "FMC1"
+#define FTY_METRIC_CACHE_SHM_VERSION  1
+
+#define FTY_METRIC_CACHE_SHM_ELEMENT_SIZE 64
+#define FTY_METRIC_CACHE_SHM_TYPE_SIZE    64
+#define FTY_METRIC_CACHE_SHM_VALUE_SIZE   32
+#define FTY_METRIC_CACHE_SHM_UNIT_SIZE    16
+
+//  Record states
+#define FTY_METRIC_CACHE_SHM_FREE    0     // ends probing
+#define FTY_METRIC_CACHE_SHM_USED    1
+
+typedef struct {
+    uint32_t magic;             // set last when the object is ready, cleared
+                                // when the agent stops
+    uint32_t version;
+    uint32_t slots;             // number of records following the header
+    uint32_t record_size;       // sizeof (fty_metric_cache_shm_record_t)
+    uint64_t moves;             // odd while records are shifted back after
+                                // a removal
+} fty_metric_cache_shm_header_t;
+
+typedef struct {
+    uint64_t sequence;          // odd while being written
+    uint32_t state;             // FTY_METRIC_CACHE_SHM_FREE or _USED
+    uint32_t ttl;
+    uint64_t time;              // seconds since epoch
+    char element [FTY_METRIC_CACHE_SHM_ELEMENT_SIZE];
+    char type [FTY_METRIC_CACHE_SHM_TYPE_SIZE];
+    char value [FTY_METRIC_CACHE_SHM_VALUE_SIZE];
+    char unit [FTY_METRIC_CACHE_SHM_UNIT_SIZE];
+} fty_metric_cache_shm_record_t;
+
+typedef struct {
+    fty_metric_cache_shm_header_t *header;
+    fty_metric_cache_shm_record_t *records;
+    size_t size;                // of the mapping
+} fty_metric_cache_shm_t;
+
+//  Slot where probing for (element, type) starts (FNV-1a)
+static inline uint32_t
+fty_metric_cache_shm_slot (const char *element, const char *type, uint32_t slots)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *c = element; *c; c++)
+        hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+    hash = (hash ^ '/') * 1099511628211ULL;
+    for (const char *c = type; *c; c++)
+        hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+    return (uint32_t) (hash % slots);
+}
+
+//  Copy record consistently, 0 on success, -1 when it stayed locked (the
+//  agent died while writing it)
+static inline int
+fty_metric_cache_shm_read (const fty_metric_cache_shm_record_t *record, fty_metric_cache_shm_record_t *copy)
+{
+    for (int attempt = 0; attempt < 10000; attempt++) {
+        uint64_t before = __atomic_load_n (&record->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+        memcpy (copy, record, sizeof (fty_metric_cache_shm_record_t));
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        if (__atomic_load_n (&record->sequence, __ATOMIC_RELAXED) == before)
+            return 0;
+    }
+    return -1;
+}
+
+//  Map shared memory object 'name' of the agent read-only
+//  Returns 0 on success, -1 when it does not exist or is not compatible
+static inline int
+fty_metric_cache_shm_open (fty_metric_cache_shm_t *self, const char *name)
+{
+    memset (self, 0, sizeof (fty_metric_cache_shm_t));
+    int fd = shm_open (name, O_RDONLY, 0);
+    if (fd == -1)
+        return -1;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat (fd, &st) == 0 && (size_t) st.st_size >= sizeof (fty_metric_cache_shm_header_t))
+        map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    fty_metric_cache_shm_header_t *header = (fty_metric_cache_shm_header_t *) map;
+    if (__atomic_load_n (&header->magic, __ATOMIC_ACQUIRE) != FTY_METRIC_CACHE_SHM_MAGIC
+    ||  header->version != FTY_METRIC_CACHE_SHM_VERSION
+    ||  header->record_size != sizeof (fty_metric_cache_shm_record_t)
+    ||  header->slots == 0
+    ||  sizeof (fty_metric_cache_shm_header_t) + (size_t) header->slots * header->record_size > (size_t) st.st_size) {
+        munmap (map, (size_t) st.st_size);
+        return -1;
+    }
+    self->header = header;
+    self->records = (fty_metric_cache_shm_record_t *) (header + 1);
+    self->size = (size_t) st.st_size;
+    return 0;
+}
+
+//  Unmap the shared memory object
+static inline void
+fty_metric_cache_shm_close (fty_metric_cache_shm_t *self)
+{
+    if (self->header)
+        munmap (self->header, self->size);
+    memset (self, 0, sizeof (fty_metric_cache_shm_t));
+}
+
+//  Copy the latest metric 'type' of 'element' to 'record'
+//  Returns 0 when found, -1 otherwise, -2 when the agent stopped or restarted
+//  and the view has to be opened again
+static inline int
+fty_metric_cache_shm_get (
+        const fty_metric_cache_shm_t *self,
+        const char *element,
+        const char *type,
+        fty_metric_cache_shm_record_t *record)
+{
+    if (!self->header)
+        return -1;
+    if (__atomic_load_n (&self->header->magic, __ATOMIC_ACQUIRE) != FTY_METRIC_CACHE_SHM_MAGIC)
+        return -2;
+    uint32_t slots = self->header->slots;
+    uint32_t slot = fty_metric_cache_shm_slot (element, type, slots);
+    for (int attempt = 0; attempt < 10000; attempt++) {
+        uint64_t moves = __atomic_load_n (&self->header->moves, __ATOMIC_ACQUIRE);
+        if (moves & 1)
+            continue;
+        int result = -1;
+        for (uint32_t probe = 0; probe < slots; probe++) {
+            if (fty_metric_cache_shm_read (&self->records [(slot + probe) % slots], record) != 0)
+                return -1;
+            if (record->state == FTY_METRIC_CACHE_SHM_FREE)
+                break;
+            if (strncmp (record->element, element, FTY_METRIC_CACHE_SHM_ELEMENT_SIZE) == 0
+            &&  strncmp (record->type, type, FTY_METRIC_CACHE_SHM_TYPE_SIZE) == 0) {
+                result = 0;
+                break;
+            }
+        }
+        // a record shifted back behind the probe was missed, look again
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        if (__atomic_load_n (&self->header->moves, __ATOMIC_RELAXED) == moves)
+            return result;
+    }
+    return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
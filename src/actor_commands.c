@@ -135,6 +135,29 @@ actor_commands (
         zstr_free (&stream);
     }
     else
+    if (streq (cmd, "WORKER")) {
+        char *address = zmsg_popstr (message);
+        char *pattern = zmsg_popstr (message);
+        if (!address || !pattern) {
+            log_error (
+                    "Expected multipart string format: WORKER/address/pattern. "
+                    "Received WORKER/%s/%s", address ? address : "nullptr", pattern ? pattern : "nullptr");
+            zstr_free (&pattern);
+            zstr_free (&address);
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        int rv = mlm_client_set_worker (client, address, pattern);
+        if (rv == -1) {
+            log_error (
+                    "mlm_client_set_worker (address = '%s', pattern = '%s') failed",
+                    address, pattern);
+        }
+        zstr_free (&pattern);
+        zstr_free (&address);
+    }
+    else
     if (streq (cmd, "CONFIGURE")) {
         char *state_file = zmsg_popstr (message);
         if (!state_file) {
@@ -149,6 +172,118 @@ actor_commands (
         rt_load (data, state_file);
         zstr_free (&state_file);
     }
+    else
+    if (streq (cmd, "HISTORY")) {
+        char *pattern = zmsg_popstr (message);
+        char *size = zmsg_popstr (message);
+        if (!pattern || !size) {
+            log_error (
+                    "Expected multipart string format: HISTORY/pattern/size. "
+                    "Received HISTORY/%s/nullptr", pattern ? pattern : "nullptr");
+            zstr_free (&pattern);
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        int samples = atoi (size);
+        rt_set_history (data, streq (pattern, "") ? NULL : pattern, samples > 0 ? (size_t) samples : 0);
+        zstr_free (&size);
+        zstr_free (&pattern);
+    }
+    else
+    if (streq (cmd, "ROLLUP")) {
+        char *pattern = zmsg_popstr (message);
+        if (!pattern) {
+            log_error (
+                    "Expected multipart string format: ROLLUP/pattern. "
+                    "Received ROLLUP/nullptr");
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        rt_set_rollup (data, streq (pattern, "") ? NULL : pattern);
+        zstr_free (&pattern);
+    }
+    else
+    if (streq (cmd, "MEMORY")) {
+        char *bytes = zmsg_popstr (message);
+        if (!bytes) {
+            log_error (
+                    "Expected multipart string format: MEMORY/bytes. "
+                    "Received MEMORY/nullptr");
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        rt_set_memory_limit (data, (size_t) strtoull (bytes, NULL, 10));
+        zstr_free (&bytes);
+    }
+    else
+    if (streq (cmd, "LIMITS")) {
+        char *per_element = zmsg_popstr (message);
+        char *types = zmsg_popstr (message);
+        if (!per_element || !types) {
+            log_error (
+                    "Expected multipart string format: LIMITS/per_element/types. "
+                    "Received LIMITS/%s/nullptr", per_element ? per_element : "nullptr");
+            zstr_free (&per_element);
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        rt_set_cardinality_limits (data,
+                (size_t) strtoull (per_element, NULL, 10), (size_t) strtoull (types, NULL, 10));
+        zstr_free (&types);
+        zstr_free (&per_element);
+    }
+    else
+    if (streq (cmd, "VIEW")) {
+        char *name = zmsg_popstr (message);
+        char *slots = zmsg_popstr (message);
+        if (!name || (!streq (name, "") && !slots)) {
+            log_error (
+                    "Expected multipart string format: VIEW/name/slots. "
+                    "Received VIEW/%s/nullptr", name ? name : "nullptr");
+            zstr_free (&name);
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        shm_view_t *view = NULL;
+        if (!streq (name, ""))
+            view = shm_view_new (name, (size_t) strtoull (slots, NULL, 10));
+        rt_set_view (data, &view);
+        zstr_free (&slots);
+        zstr_free (&name);
+    }
+    else
+    if (streq (cmd, "TOPOLOGY")) {
+        char *pattern = zmsg_popstr (message);
+        if (!pattern) {
+            log_error (
+                    "Expected multipart string format: TOPOLOGY/pattern. "
+                    "Received TOPOLOGY/nullptr");
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        rt_set_topology (data, streq (pattern, "") ? NULL : pattern);
+        zstr_free (&pattern);
+    }
+    else
+    if (streq (cmd, "COUNTERS")) {
+        char *pattern = zmsg_popstr (message);
+        if (!pattern) {
+            log_error (
+                    "Expected multipart string format: COUNTERS/pattern. "
+                    "Received COUNTERS/nullptr");
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        rt_set_counters (data, streq (pattern, "") ? NULL : pattern);
+        zstr_free (&pattern);
+    }
     else {
         log_warning ("Command '%s' is unknown or not implemented", cmd);
     }
@@ -346,6 +481,21 @@ actor_commands_test (bool verbose)
 
     STDERR_NON_EMPTY
 
+    // --------------------------------------------------------------
+    fp = freopen ("stderr.txt", "w+", stderr);
+    // WORKER - expected fail
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "WORKER");
+    zmsg_addstr (message, "some-service");
+    // missing pattern here
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (fullpath == NULL);
+
+    STDERR_NON_EMPTY
+
     // --------------------------------------------------------------
     fp = freopen ("stderr.txt", "w+", stderr);
     // PRODUCER - expected fail
@@ -360,6 +510,21 @@ actor_commands_test (bool verbose)
 
     STDERR_NON_EMPTY
 
+    // --------------------------------------------------------------
+    fp = freopen ("stderr.txt", "w+", stderr);
+    // HISTORY - expected fail
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "HISTORY");
+    zmsg_addstr (message, "temperature");
+    // missing size here
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (fullpath == NULL);
+
+    STDERR_NON_EMPTY
+
     // The original client still waiting on the bad endpoint for malamute
     // server to show up. Therefore we must destroy and create it again.
     mlm_client_destroy (&client);
@@ -400,6 +565,17 @@ actor_commands_test (bool verbose)
     assert (message == NULL);
     assert (fullpath == NULL);
 
+    // WORKER
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "WORKER");
+    zmsg_addstr (message, "some-service");
+    zmsg_addstr (message, "latest-rt-data");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (fullpath == NULL);
+
     // PRODUCER
     message = zmsg_new ();
     assert (message);
@@ -410,6 +586,116 @@ actor_commands_test (bool verbose)
     assert (message == NULL);
     assert (fullpath == NULL);
 
+    // HISTORY
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "HISTORY");
+    zmsg_addstr (message, "temperature|realpower\\..*");
+    zmsg_addstr (message, "60");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->history_size == 60);
+
+    // ROLLUP
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "ROLLUP");
+    zmsg_addstr (message, "realpower\\..*");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->rollup_rex);
+
+    // MEMORY
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "MEMORY");
+    zmsg_addstr (message, "1048576");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->memory_limit == 1048576);
+
+    // LIMITS
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "LIMITS");
+    zmsg_addstr (message, "100");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->element_limit == 0);
+
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "LIMITS");
+    zmsg_addstr (message, "100");
+    zmsg_addstr (message, "1000");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->element_limit == 100);
+    assert (data->types_limit == 1000);
+
+    // VIEW
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "VIEW");
+    zmsg_addstr (message, "/fty-metric-cache-commands-test");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->view == NULL);
+
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "VIEW");
+    zmsg_addstr (message, "/fty-metric-cache-commands-test");
+    zmsg_addstr (message, "64");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->view);
+
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "VIEW");
+    zmsg_addstr (message, "");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->view == NULL);
+
+    // TOPOLOGY
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "TOPOLOGY");
+    zmsg_addstr (message, "realpower\\.default");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->topology_rex);
+
+    // COUNTERS
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "COUNTERS");
+    zmsg_addstr (message, "energy");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->counter_rex);
+
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, "COUNTERS");
+    zmsg_addstr (message, "");
+    rv = actor_commands (client, &message, data, &fullpath);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (data->counter_rex == NULL);
+
     // CONFIGURE
     char *test_state_file = zsys_sprintf ("%s/test_state_file", SELFTEST_DIR_RO);
     assert (test_state_file != NULL);
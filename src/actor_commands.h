@@ -44,10 +44,44 @@ extern "C" {
 //  CONSUMER/stream/pattern
 //      consume messages from 'stream' with subjects matching 'pattern'
 //
+//  WORKER/address/pattern
+//      offer service 'address' for requests with subjects matching 'pattern'
+//
 //  CONFIGURE/state_file
 //      configure actor, where
 //
 //      state_file - full pathname of state file
+//
+//  HISTORY/pattern/size
+//      keep history of the last 'size' samples of metrics with type matching
+//      regex 'pattern', empty pattern or zero size disables history; send it
+//      before CONFIGURE so that it applies to metrics loaded from state file
+//
+//  ROLLUP/pattern
+//      maintain 1 and 15 minutes rollups of metrics with type matching regex
+//      'pattern', empty pattern disables rollups; send it before CONFIGURE
+//
+//  MEMORY/bytes
+//      limit memory used by metrics to 'bytes', evicting the least recently
+//      updated metrics over it; 0 means no limit
+//
+//  LIMITS/per_element/types
+//      limit number of distinct measurements of one element and number of
+//      distinct measurement types, new measurements over them are dropped;
+//      0 means no limit
+//
+//  TOPOLOGY/pattern
+//      sum metrics with type matching regex 'pattern' into totals of their
+//      ancestors learned from ASSETS stream, empty pattern disables it
+//
+//  COUNTERS/pattern
+//      derive '<type>.rate' metrics from counters with type matching regex
+//      'pattern', empty pattern disables it
+//
+//  VIEW/name/slots
+//      keep copy of the metrics in shared memory object 'name' with room for
+//      'slots' metrics, see include/fty_metric_cache_shm.h; empty name
+//      disables it
 
 // Performs the actor commands logic
 // Destroys the message
@@ -37,7 +37,27 @@ static const char *STATE_FILE = "/var/lib/fty/fty-metric-cache/state_file";
 void usage () {
     puts ("fty-metric-cache [options] ...\n"
           "  --verbose / -v         verbosity level\n"
-          "  --state-file / -s      TODO\n"
+          "  --state-file / -s      path to state file\n"
+          "  --history-types / -t   regex of metric types to keep history of\n"
+          "  --history-size / -n    number of samples in history (default 60)\n"
+          "  --rollup-types / -r    regex of metric types to keep rollups of\n"
+          "  --counter-types / -c   regex of counter types to derive rates of\n"
+          "  --memory-limit / -m    bytes of memory for metrics (default 0 - no limit)\n"
+          "  --element-limit / -e   metric types of one asset (default 0 - no limit)\n"
+          "  --types-limit / -y     distinct metric types (default 0 - no limit)\n"
+          "  --assets / -a          drop metrics of deleted and retired assets\n"
+          "  --topology-types / -o  regex of metric types to sum per rack, room, ...\n"
+          "                         (implies --assets)\n"
+          "  --service / -w         also answer requests for service " FTY_METRIC_CACHE_SERVICE "\n"
+          "  --name / -N            mailbox name (default " FTY_METRIC_CACHE_MAILBOX "), unique\n"
+          "                         per instance when several offer the service\n"
+          "  --router / -R          endpoint of ROUTER socket for direct requests,\n"
+          "                         e.g. ipc://@/fty-metric-cache\n"
+          "  --ingest / -i          endpoint of PULL socket for metrics pushed directly,\n"
+          "                         e.g. ipc://@/fty-metric-cache-ingest\n"
+          "  --shm / -S             name of shared memory object to publish metrics in,\n"
+          "                         e.g. " FTY_METRIC_CACHE_SHM_NAME "\n"
+          "  --shm-slots / -k       number of metrics it has room for (default 16384)\n"
           "  --help / -h            this information\n"
           );
 }
@@ -47,6 +67,21 @@ int main (int argc, char *argv [])
     int help = 0;
     bool verbose = false;
     char *state_file = NULL;
+    char *history_types = NULL;
+    char *history_size = (char *) "60";
+    char *rollup_types = NULL;
+    char *counter_types = NULL;
+    char *memory_limit = NULL;
+    char *element_limit = (char *) "0";
+    char *types_limit = (char *) "0";
+    bool assets = false;
+    char *topology_types = NULL;
+    bool service = false;
+    char *name = (char *) FTY_METRIC_CACHE_MAILBOX;
+    char *router = NULL;
+    char *ingest = NULL;
+    char *shm = NULL;
+    char *shm_slots = (char *) "16384";
 
     ftylog_setInstance("fty-metric-cache", LOG_CONFIG);
     while (true) {
@@ -55,11 +90,26 @@ int main (int argc, char *argv [])
             {"help",            no_argument,        0,  1},
             {"verbose",         no_argument,        0,  'v'},
             {"state-file",      required_argument,  0,  's'},
+            {"history-types",   required_argument,  0,  't'},
+            {"history-size",    required_argument,  0,  'n'},
+            {"rollup-types",    required_argument,  0,  'r'},
+            {"counter-types",   required_argument,  0,  'c'},
+            {"memory-limit",    required_argument,  0,  'm'},
+            {"element-limit",   required_argument,  0,  'e'},
+            {"types-limit",     required_argument,  0,  'y'},
+            {"assets",          no_argument,        0,  'a'},
+            {"topology-types",  required_argument,  0,  'o'},
+            {"service",         no_argument,        0,  'w'},
+            {"name",            required_argument,  0,  'N'},
+            {"router",          required_argument,  0,  'R'},
+            {"ingest",          required_argument,  0,  'i'},
+            {"shm",             required_argument,  0,  'S'},
+            {"shm-slots",       required_argument,  0,  'k'},
             {0,                 0,                  0,  0}
         };
 
         int option_index = 0;
-        int c = getopt_long (argc, argv, "hvs:", long_options, &option_index);
+        int c = getopt_long (argc, argv, "hvs:t:n:r:c:m:e:y:ao:wN:R:i:S:k:", long_options, &option_index);
         if (c == -1)
             break;
         switch (c) {
@@ -73,6 +123,82 @@ int main (int argc, char *argv [])
                 state_file = optarg;
                 break;
             }
+            case 't':
+            {
+                history_types = optarg;
+                break;
+            }
+            case 'n':
+            {
+                history_size = optarg;
+                break;
+            }
+            case 'r':
+            {
+                rollup_types = optarg;
+                break;
+            }
+            case 'c':
+            {
+                counter_types = optarg;
+                break;
+            }
+            case 'm':
+            {
+                memory_limit = optarg;
+                break;
+            }
+            case 'e':
+            {
+                element_limit = optarg;
+                break;
+            }
+            case 'y':
+            {
+                types_limit = optarg;
+                break;
+            }
+            case 'a':
+            {
+                assets = true;
+                break;
+            }
+            case 'o':
+            {
+                topology_types = optarg;
+                assets = true;
+                break;
+            }
+            case 'w':
+            {
+                service = true;
+                break;
+            }
+            case 'N':
+            {
+                name = optarg;
+                break;
+            }
+            case 'R':
+            {
+                router = optarg;
+                break;
+            }
+            case 'i':
+            {
+                ingest = optarg;
+                break;
+            }
+            case 'S':
+            {
+                shm = optarg;
+                break;
+            }
+            case 'k':
+            {
+                shm_slots = optarg;
+                break;
+            }
             case 'h':
             default:
             {
@@ -99,9 +225,30 @@ int main (int argc, char *argv [])
         log_fatal ("zactor_new (task = 'fty_metric_cache_server', args = 'NULL') failed");
         return EXIT_FAILURE;
     }
+    if (history_types)
+        zstr_sendx (rt_server,  "HISTORY", history_types, history_size, NULL);
+    if (rollup_types)
+        zstr_sendx (rt_server,  "ROLLUP", rollup_types, NULL);
+    if (counter_types)
+        zstr_sendx (rt_server,  "COUNTERS", counter_types, NULL);
+    if (memory_limit)
+        zstr_sendx (rt_server,  "MEMORY", memory_limit, NULL);
+    zstr_sendx (rt_server,  "LIMITS", element_limit, types_limit, NULL);
+    if (topology_types)
+        zstr_sendx (rt_server,  "TOPOLOGY", topology_types, NULL);
+    if (shm)
+        zstr_sendx (rt_server,  "VIEW", shm, shm_slots, NULL);
     zstr_sendx (rt_server,  "CONFIGURE", state_file, NULL);
-    zstr_sendx (rt_server,  "CONNECT", ENDPOINT, FTY_METRIC_CACHE_MAILBOX, NULL);
+    zstr_sendx (rt_server,  "CONNECT", ENDPOINT, name, NULL);
     zstr_sendx (rt_server,  "CONSUMER", FTY_PROTO_STREAM_METRICS, ".*", NULL);
+    if (assets)
+        zstr_sendx (rt_server,  "CONSUMER", FTY_PROTO_STREAM_ASSETS, ".*", NULL);
+    if (service)
+        zstr_sendx (rt_server,  "WORKER", FTY_METRIC_CACHE_SERVICE, RFC_RT_DATA_SUBJECT, NULL);
+    if (router)
+        zstr_sendx (rt_server,  "ROUTER", router, NULL);
+    if (ingest)
+        zstr_sendx (rt_server,  "PULL", ingest, NULL);
 
     while (true) {
         char *message = zstr_recv (rt_server);
@@ -39,12 +39,47 @@
 typedef struct _actor_commands_t actor_commands_t;
 #define ACTOR_COMMANDS_T_DEFINED
 #endif
+#ifndef SHM_VIEW_T_DEFINED
+typedef struct _shm_view_t shm_view_t;
+#define SHM_VIEW_T_DEFINED
+#endif
 #ifndef RT_T_DEFINED
 typedef struct _rt_t rt_t;
 /* Note: The definition below disappeared with a recent re-generation;
  * maybe more files should be removed and regenerated to be clean? */
 struct _rt_t {
-    zhashx_t *devices;      // hash of hashes ("device name", ("measurement", fty_proto_t*))
+    zhashx_t *devices;      // hash ("device name", rt_device_t*), see rt.h
+    zhashx_t *types;        // index of the above ("measurement", ("device name", rt_metric_t*)),
+                            // does not own the records
+    char *devices_list;     // cached reply of rt_get_list_devices, NULL when
+                            // the set of devices changed since it was built
+    zrex_t *history_rex;    // types of measurements with history, NULL for none
+    size_t history_size;    // number of samples in history
+    zrex_t *rollup_rex;     // types of measurements with rollups, NULL for none
+    zrex_t *counter_rex;    // types of counters with derived rates, NULL for none
+    uint64_t device_generation;  // bumped by every change of a device, including
+                                 // refreshes, see rt_device_t
+    uint64_t devices_generation; // device_generation when a device was last
+                                 // added or removed
+    uint64_t totals_generation;  // device_generation when an element last
+                                 // gained or lost totals
+    uint64_t updates;       // number of stored messages
+    uint64_t refreshes;     // of them only refreshing time and ttl of a record
+    zlistx_t *lru;          // records from the least recently updated, does not
+                            // own them
+    size_t bytes;           // approximate memory used by the records
+    size_t memory_limit;    // limit of 'bytes', 0 for none
+    uint64_t evictions;     // number of records evicted over the limit
+    uint64_t evictions_unlogged; // of them not logged yet
+    int64_t evictions_logged_at; // time (ms) evictions were last logged
+    size_t element_limit;   // limit of distinct measurements of an element, 0 for none
+    size_t types_limit;     // limit of distinct measurement types, 0 for none
+    uint64_t rejected_element; // new measurements rejected over 'element_limit'
+    uint64_t rejected_types;   // new measurements rejected over 'types_limit'
+    zrex_t *topology_rex;   // types of measurements summed into totals, NULL for none
+    zhashx_t *parents;      // hash ("device name", zlistx_t* of ancestor names)
+    zhashx_t *totals;       // hash ("ancestor name", ("measurement", rt_metric_t*))
+    shm_view_t *view;       // copy of the records in shared memory, NULL for none
 };
 #define RT_T_DEFINED
 #endif
@@ -52,14 +87,26 @@ struct _rt_t {
 typedef struct _mailbox_t mailbox_t;
 #define MAILBOX_T_DEFINED
 #endif
+#ifndef OUTBOX_T_DEFINED
+typedef struct _outbox_t outbox_t;
+#define OUTBOX_T_DEFINED
+#endif
+#ifndef REPLY_CACHE_T_DEFINED
+typedef struct _reply_cache_t reply_cache_t;
+#define REPLY_CACHE_T_DEFINED
+#endif
 
 //  Extra headers
+#include "../include/fty_metric_cache_shm.h"
 
 //  Internal API
 
 #include "actor_commands.h"
 #include "rt.h"
 #include "mailbox.h"
+#include "outbox.h"
+#include "reply_cache.h"
+#include "shm_view.h"
 
 //  *** To avoid double-definitions, only define if building without draft ***
 #ifndef FTY_METRIC_CACHE_BUILD_DRAFT_API
@@ -79,6 +126,21 @@ FTY_METRIC_CACHE_PRIVATE void
 FTY_METRIC_CACHE_PRIVATE void
     mailbox_test (bool verbose);
 
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_METRIC_CACHE_PRIVATE void
+    outbox_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_METRIC_CACHE_PRIVATE void
+    reply_cache_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_METRIC_CACHE_PRIVATE void
+    shm_view_test (bool verbose);
+
 //  Self test for private classes
 FTY_METRIC_CACHE_PRIVATE void
     fty_metric_cache_private_selftest (bool verbose, const char *subtest);
@@ -71,6 +71,66 @@ reciver (mlm_client_t *client, int timeout)
     return NULL;
 }
 
+//  Requests outstanding at most in benchmark
+#define BENCH_WINDOW 100
+
+//  Send 'count' GET requests for 'device' keeping up to BENCH_WINDOW of them
+//  outstanding, through malamute or directly to ROUTER endpoint of the agent
+//  when 'dealer' is given, and print throughput and round trip times
+
+static void
+s_benchmark_get (mlm_client_t *cli, zsock_t *dealer, const char *device, int count)
+{
+    int64_t *sent = (int64_t *) zmalloc (count * sizeof (int64_t));
+    assert (sent);
+    int next = 0;
+    int received = 0;
+    int64_t total = 0;
+    int64_t maximum = 0;
+    int64_t start = zclock_usecs ();
+    while (received < count) {
+        while (next < count && next - received < BENCH_WINDOW) {
+            zmsg_t *send = zmsg_new ();
+            zmsg_addstrf (send, "%d", next);
+            zmsg_addstr (send, "GET");
+            zmsg_addstr (send, device);
+            sent [next] = zclock_usecs ();
+            int rv = dealer ?
+                zmsg_send (&send, dealer) :
+                mlm_client_sendto (cli, FTY_METRIC_CACHE_MAILBOX, RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+            zmsg_destroy (&send);
+            if (rv != 0)
+                break;
+            next++;
+        }
+        zmsg_t *reply = dealer ? zmsg_recv (dealer) : reciver (cli, 5000);
+        if (!reply)
+            break;
+        char *uuid = zmsg_popstr (reply);
+        int i = uuid ? atoi (uuid) : -1;
+        if (i >= 0 && i < next) {
+            int64_t latency = zclock_usecs () - sent [i];
+            total += latency;
+            if (latency > maximum)
+                maximum = latency;
+        }
+        zstr_free (&uuid);
+        zmsg_destroy (&reply);
+        received++;
+    }
+    int64_t elapsed = zclock_usecs () - start;
+
+    if (received < count)
+        log_error ("%s: no agent response after %d of %d requests",
+                dealer ? "router" : "malamute", received, count);
+    else
+        log_info ("%s: %d requests in %.3f s, %.0f requests/s, round trip average %" PRIi64 " us, max %" PRIi64 " us",
+                dealer ? "router" : "malamute", count, elapsed / 1e6,
+                elapsed > 0 ? count * 1e6 / elapsed : 0.0,
+                total / count, maximum);
+    free (sent);
+}
+
 int main (int argc, char *argv [])
 {
     ftylog_setInstance("fty-metric-cache-cli", LOG_CONFIG);
@@ -99,6 +159,9 @@ int main (int argc, char *argv [])
             puts ("             device          device name or a regex");
             puts ("             [filter]        regex filter to select specific metric name");
             puts ("  --list / -l                print list of devices known to the agent");
+            puts ("  --bench / -b count device [endpoint]");
+            puts ("                             measure 'count' GET requests of 'device' through");
+            puts ("                             malamute and, if given, ROUTER 'endpoint' of agent");
             puts ("  --verbose / -v             verbose output");
             puts ("  --help / -h                this information");
             break;
@@ -116,6 +179,34 @@ int main (int argc, char *argv [])
             list_devices(client);
             break;
         }
+        else
+        if (    streq (argv [argn], "--bench")
+             || streq (argv [argn], "-b"))
+        {
+            if (argn + 2 >= argc) {
+                log_error ("agent-rt-cli:\t--bench expects count and device");
+                mlm_client_destroy (&client);
+                return -1;
+            }
+            int count = atoi (argv [argn + 1]);
+            const char *device = argv [argn + 2];
+            if (count > 0) {
+                s_benchmark_get (client, NULL, device, count);
+                if (argn + 3 < argc) {
+                    zsock_t *dealer = zsock_new_dealer (argv [argn + 3]);
+                    if (dealer) {
+                        zsock_set_rcvtimeo (dealer, 5000);
+                        s_benchmark_get (client, dealer, device, count);
+                        zsock_destroy (&dealer);
+                    }
+                    else
+                        log_error ("agent-rt-cli:\tCannot connect to '%s'", argv [argn + 3]);
+                }
+            }
+            zpoller_destroy (&poller);
+            mlm_client_destroy (&client);
+            return 0;
+        }
         else {
             char* filter=(argn==(argc-2))?argv[argn+1]:NULL;
             print_device(argv [argn], filter, client);
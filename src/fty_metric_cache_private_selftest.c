@@ -44,6 +44,12 @@ fty_metric_cache_private_selftest (bool verbose, const char *subtest)
         rt_test (verbose);
     if (streq (subtest, "$ALL") || streq (subtest, "mailbox_test"))
         mailbox_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "outbox_test"))
+        outbox_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "reply_cache_test"))
+        reply_cache_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "shm_view_test"))
+        shm_view_test (verbose);
 }
 /*
 ################################################################################
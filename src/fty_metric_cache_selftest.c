@@ -45,6 +45,9 @@ all_tests [] = {
     { "actor_commands", NULL, true, false, "actor_commands_test" },
     { "rt", NULL, true, false, "rt_test" },
     { "mailbox", NULL, true, false, "mailbox_test" },
+    { "outbox", NULL, true, false, "outbox_test" },
+    { "reply_cache", NULL, true, false, "reply_cache_test" },
+    { "shm_view", NULL, true, false, "shm_view_test" },
     { "private_classes", NULL, false, false, "$ALL" }, // compat option for older projects
 #endif // FTY_METRIC_CACHE_BUILD_DRAFT_API
 // Tests for stable public classes:
@@ -30,42 +30,394 @@
 
 #define POLL_INTERVAL 30000
 
+//  Messages handled at most per wakeup of the poller
+#define DRAIN_BATCH 64
+
+//  Defaults of scheduling, see SCHEDULE command
+#define INGEST_BUDGET 10
+#define INGEST_LIMIT 10000
+
+//  Ingest lag (ms) reported as a warning
+#define INGEST_LAG_WARNING 1000
+
+//  Replies queued per client at most
+#define OUTBOX_LIMIT 100
+
+//  Poll timeout (ms) while replies wait for the client to accept them
+#define OUTBOX_RETRY 10
+
+//  Replies shared by identical requests at most, and for how long (ms)
+#define REPLY_CACHE_LIMIT 256
+#define REPLY_CACHE_WINDOW 250
+
+//  Stream message waiting to be stored
+
+typedef struct {
+    zmsg_t *message;
+    int64_t queued;         // zclock_mono () when it was received
+} s_ingest_t;
+
+static void
+s_ingest_destroy (s_ingest_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    zmsg_destroy (&(*self_p)->message);
+    free (*self_p);
+    *self_p = NULL;
+}
+
+//  Scheduling of ingest against queries. Queries are answered as soon as
+//  they are received, stream messages are queued and stored within a time
+//  budget per wakeup, so a flood of metrics cannot hold replies back.
+
+typedef struct {
+    zlistx_t *ingest;       // s_ingest_t*, the oldest first
+    int64_t budget;         // ms spent storing queued messages per wakeup
+    size_t limit;           // queued messages at most, the oldest one is stored
+                            // at once to make room for another
+    int64_t max_lag;        // the longest wait (ms) of a stored message since
+                            // the last report
+    uint64_t overflows;     // messages stored out of budget to make room since
+                            // the last report
+} s_scheduler_t;
+
+//  Handle SCHEDULE/budget/limit actor command, return false for other commands
+
+static bool
+s_scheduler_command (s_scheduler_t *self, zmsg_t **message_p)
+{
+    if (!zframe_streq (zmsg_first (*message_p), "SCHEDULE"))
+        return false;
+
+    zmsg_t *message = *message_p;
+    char *cmd = zmsg_popstr (message);
+    char *budget = zmsg_popstr (message);
+    char *limit = zmsg_popstr (message);
+    if (!budget || !limit) {
+        log_error (
+                "Expected multipart string format: SCHEDULE/budget/limit. "
+                "Received SCHEDULE/%s/nullptr", budget ? budget : "nullptr");
+    }
+    else {
+        self->budget = atoll (budget);
+        self->limit = (size_t) strtoull (limit, NULL, 10);
+        if (self->limit == 0)
+            self->limit = 1;
+    }
+    zstr_free (&limit);
+    zstr_free (&budget);
+    zstr_free (&cmd);
+    zmsg_destroy (message_p);
+    return true;
+}
+
+//  Handle ROUTER/endpoint and PULL/endpoint actor commands binding socket
+//  of 'type' named 'name', return false for other commands
+
+static bool
+s_socket_command (const char *name, int type, zsock_t **socket_p, zpoller_t *poller, zmsg_t **message_p)
+{
+    if (!zframe_streq (zmsg_first (*message_p), name))
+        return false;
+
+    zmsg_t *message = *message_p;
+    char *cmd = zmsg_popstr (message);
+    char *endpoint = zmsg_popstr (message);
+    if (!endpoint) {
+        log_error (
+                "Expected multipart string format: %s/endpoint. "
+                "Received %s/nullptr", name, name);
+    }
+    else {
+        if (*socket_p) {
+            zpoller_remove (poller, *socket_p);
+            zsock_destroy (socket_p);
+        }
+        if (!streq (endpoint, "")) {
+            *socket_p = zsock_new (type);
+            assert (*socket_p);
+            if (zsock_attach (*socket_p, endpoint, true) == 0)
+                zpoller_add (poller, *socket_p);
+            else {
+                log_error ("zsock_attach (type = %s, endpoint = '%s') failed", name, endpoint);
+                zsock_destroy (socket_p);
+            }
+        }
+    }
+    zstr_free (&endpoint);
+    zstr_free (&cmd);
+    zmsg_destroy (message_p);
+    return true;
+}
+
 static void
-s_handle_poll (rt_t *data)
+s_handle_poll (rt_t *data, s_scheduler_t *scheduler, outbox_t *outbox, reply_cache_t *cache)
 {
     rt_purge (data);
+    log_debug ("%.1f %% of updates only refreshed time and ttl",
+            100.0 * rt_get_refresh_ratio (data));
+    if (scheduler->max_lag >= INGEST_LAG_WARNING)
+        log_warning ("Metrics waited up to %" PRIi64 " ms to be stored, %zu are queued",
+                scheduler->max_lag, zlistx_size (scheduler->ingest));
+    else
+        log_debug ("Metrics waited up to %" PRIi64 " ms to be stored", scheduler->max_lag);
+    if (scheduler->overflows > 0)
+        log_warning ("%" PRIu64 " metrics were stored out of budget, more than %zu were queued",
+                scheduler->overflows, scheduler->limit);
+    scheduler->max_lag = 0;
+    scheduler->overflows = 0;
+    outbox_report (outbox);
+    reply_cache_report (cache);
 }
 
+//  Requests for the service (see WORKER command) follow the mailbox protocol,
+//  replies go to the mailbox of the sender
+
 static void
-s_handle_service (mlm_client_t *client, zmsg_t **message_p)
+s_handle_service (mlm_client_t *client, zmsg_t **message_p, rt_t *data, outbox_t *outbox, reply_cache_t *cache)
 {
     assert (client);
     assert (message_p && *message_p);
 
-    log_error ("Service deliver is not implemented.");
+    mailbox_perform (client, message_p, data, outbox, cache);
 
     zmsg_destroy (message_p);
 }
 
 static void
-s_handle_mailbox (mlm_client_t *client, zmsg_t **message_p, rt_t *data)
+s_handle_mailbox (mlm_client_t *client, zmsg_t **message_p, rt_t *data, outbox_t *outbox, reply_cache_t *cache)
 {
     assert (client);
     assert (message_p && *message_p);
 
-    mailbox_perform (client, message_p, data);
+    mailbox_perform (client, message_p, data, outbox, cache);
 
     zmsg_destroy (message_p);
 }
 
+//  Requests on the ROUTER endpoint follow the mailbox protocol, each one
+//  prefixed by identity of the peer
+
 static void
-s_handle_stream (mlm_client_t *client, zmsg_t **message_p, rt_t *data)
+s_handle_router (zsock_t *router, rt_t *data, reply_cache_t *cache)
+{
+    assert (router);
+
+    for (int handled = 0; handled < DRAIN_BATCH; handled++) {
+        if (handled > 0 && !(zsock_events (router) & ZMQ_POLLIN))
+            break;
+        zmsg_t *message = zmsg_recv (router);
+        if (!message)
+            break;
+        zframe_t *identity = zmsg_pop (message);
+        zmsg_t *reply = mailbox_reply ("router", &message, data, cache);
+        if (reply && identity) {
+            zmsg_prepend (reply, &identity);
+            // ROUTER drops the reply rather than block when the peer is slow
+            zmsg_send (&reply, router);
+        }
+        zmsg_destroy (&reply);
+        zframe_destroy (&identity);
+        zmsg_destroy (&message);
+    }
+}
+
+//  Queue stream message to be stored
+
+static void
+s_queue_ingest (s_scheduler_t *self, zmsg_t **message_p)
+{
+    s_ingest_t *item = (s_ingest_t *) zmalloc (sizeof (s_ingest_t));
+    assert (item);
+    item->message = *message_p;
+    *message_p = NULL;
+    item->queued = zclock_mono ();
+    zlistx_add_end (self->ingest, item);
+}
+
+//  Metrics on the PULL endpoint are queued like those of the stream, as long
+//  as there is room for them
+
+static void
+s_handle_pull (zsock_t *pull, s_scheduler_t *scheduler)
+{
+    assert (pull);
+
+    for (int handled = 0; handled < DRAIN_BATCH; handled++) {
+        if (zlistx_size (scheduler->ingest) >= scheduler->limit)
+            break;
+        if (handled > 0 && !(zsock_events (pull) & ZMQ_POLLIN))
+            break;
+        zmsg_t *message = zmsg_recv (pull);
+        if (!message)
+            break;
+        s_queue_ingest (scheduler, &message);
+    }
+}
+
+//  Store batch of metrics of one element (see FTY_METRIC_CACHE_BATCH)
+
+static void
+s_handle_batch (zmsg_t **message_p, rt_t *data)
+{
+    zmsg_t *message = *message_p;
+    char *marker = zmsg_popstr (message);
+    char *name = zmsg_popstr (message);
+    char *time = zmsg_popstr (message);
+    if (!name || !time) {
+        log_error ("Expected multipart string format: " FTY_METRIC_CACHE_BATCH "/name/time/(type/value/unit/ttl)^i");
+    }
+    else {
+        zlistx_t *messages = zlistx_new ();
+        zlistx_set_destructor (messages, (czmq_destructor *) fty_proto_destroy);
+        uint64_t timestamp = strtoull (time, NULL, 10);
+        char *type = zmsg_popstr (message);
+        while (type) {
+            char *value = zmsg_popstr (message);
+            char *unit = zmsg_popstr (message);
+            char *ttl = zmsg_popstr (message);
+            if (ttl) {
+                fty_proto_t *proto = fty_proto_new (FTY_PROTO_METRIC);
+                fty_proto_set_name (proto, "%s", name);
+                fty_proto_set_time (proto, timestamp);
+                fty_proto_set_type (proto, "%s", type);
+                fty_proto_set_value (proto, "%s", value);
+                fty_proto_set_unit (proto, "%s", unit);
+                fty_proto_set_ttl (proto, (uint32_t) strtoul (ttl, NULL, 10));
+                zlistx_add_end (messages, proto);
+            }
+            else
+                log_error ("Incomplete metric '%s' in batch of '%s' dropped", type, name);
+            zstr_free (&ttl);
+            zstr_free (&unit);
+            zstr_free (&value);
+            zstr_free (&type);
+            type = zmsg_popstr (message);
+        }
+        rt_put_batch (data, messages);
+        zlistx_destroy (&messages);
+    }
+    zstr_free (&time);
+    zstr_free (&name);
+    zstr_free (&marker);
+    zmsg_destroy (message_p);
+}
+
+//  Apply ASSET message to the records
+
+static void
+s_handle_asset (fty_proto_t *proto, rt_t *data)
+{
+    // metrics of assets no longer in inventory would linger until ttl
+    const char *operation = fty_proto_operation (proto);
+    if (operation
+    && (streq (operation, FTY_PROTO_ASSET_OP_DELETE) || streq (operation, FTY_PROTO_ASSET_OP_RETIRE))) {
+        if (rt_delete_element (data, fty_proto_name (proto)) == 0)
+            log_debug ("Dropped metrics of %s asset '%s'", operation, fty_proto_name (proto));
+    }
+    else
+    if (operation
+    && (streq (operation, FTY_PROTO_ASSET_OP_CREATE) || streq (operation, FTY_PROTO_ASSET_OP_UPDATE))) {
+        // other operations, like inventory, do not carry the location
+        // parent_name.1 is the direct parent, parent_name.2 its parent, ...
+        zlistx_t *ancestors = zlistx_new ();
+        for (int level = 1; ; level++) {
+            char *key = zsys_sprintf ("parent_name.%d", level);
+            const char *parent = fty_proto_aux_string (proto, key, NULL);
+            zstr_free (&key);
+            if (!parent || streq (parent, ""))
+                break;
+            zlistx_add_end (ancestors, (void *) parent);
+        }
+        rt_set_parents (data, fty_proto_name (proto), ancestors);
+        zlistx_destroy (&ancestors);
+    }
+}
+
+//  Store stream message. METRIC messages are appended to 'run', which holds
+//  consecutive metrics of one element; the run is stored at once when
+//  a message of anything else comes.
+
+static void
+s_handle_stream (zmsg_t **message_p, rt_t *data, zlistx_t *run)
 {
-    assert (client);
     assert (message_p && *message_p);
 
+    if (zframe_streq (zmsg_first (*message_p), FTY_METRIC_CACHE_BATCH)) {
+        rt_put_batch (data, run);
+        s_handle_batch (message_p, data);
+        return;
+    }
+
     fty_proto_t *proto = fty_proto_decode (message_p);
-    rt_put (data, &proto);
+    if (!proto) {
+        log_error ("fty_proto_decode () failed");
+        return;
+    }
+
+    if (fty_proto_id (proto) == FTY_PROTO_METRIC) {
+        fty_proto_t *last = (fty_proto_t *) zlistx_last (run);
+        if (last && !streq (fty_proto_name (last), fty_proto_name (proto)))
+            rt_put_batch (data, run);
+        zlistx_add_end (run, proto);
+        return;
+    }
+    rt_put_batch (data, run);
+    if (fty_proto_id (proto) == FTY_PROTO_ASSET)
+        s_handle_asset (proto, data);
+    fty_proto_destroy (&proto);
+}
+
+//  Store queued stream messages, the oldest first, until 'budget' ms run
+//  out (checked every few messages), negative 'budget' stores all
+
+static void
+s_store_queued (s_scheduler_t *self, rt_t *data, int64_t budget)
+{
+    // producers publish all metrics of an asset at once, so consecutive
+    // metrics are mostly of one element and need one lookup of it
+    zlistx_t *run = zlistx_new ();
+    zlistx_set_destructor (run, (czmq_destructor *) fty_proto_destroy);
+
+    int64_t start = zclock_mono ();
+    int64_t now = start;
+    size_t stored = 0;
+    s_ingest_t *item = (s_ingest_t *) zlistx_detach (self->ingest, NULL);
+    while (item) {
+        if (now - item->queued > self->max_lag)
+            self->max_lag = now - item->queued;
+        s_handle_stream (&item->message, data, run);
+        s_ingest_destroy (&item);
+
+        if (++stored % 16 == 0) {
+            now = zclock_mono ();
+            if (budget >= 0 && now - start >= budget)
+                break;
+        }
+        item = (s_ingest_t *) zlistx_detach (self->ingest, NULL);
+    }
+    rt_put_batch (data, run);
+    zlistx_destroy (&run);
+}
+
+//  Store the oldest queued stream message
+
+static void
+s_store_oldest (s_scheduler_t *self, rt_t *data)
+{
+    s_ingest_t *item = (s_ingest_t *) zlistx_detach (self->ingest, NULL);
+    if (!item)
+        return;
+    int64_t lag = zclock_mono () - item->queued;
+    if (lag > self->max_lag)
+        self->max_lag = lag;
+    zlistx_t *run = zlistx_new ();
+    zlistx_set_destructor (run, (czmq_destructor *) fty_proto_destroy);
+    s_handle_stream (&item->message, data, run);
+    rt_put_batch (data, run);
+    zlistx_destroy (&run);
+    s_ingest_destroy (&item);
 }
 
 void
@@ -87,6 +439,13 @@ fty_metric_cache_server (zsock_t *pipe, void *args)
 
     rt_t *data = rt_new ();
     char *fullpath = NULL;
+    zsock_t *router = NULL;
+    zsock_t *pull = NULL;
+
+    s_scheduler_t scheduler = { zlistx_new (), INGEST_BUDGET, INGEST_LIMIT, 0, 0 };
+    zlistx_set_destructor (scheduler.ingest, (czmq_destructor *) s_ingest_destroy);
+    outbox_t *outbox = outbox_new (OUTBOX_LIMIT);
+    reply_cache_t *cache = reply_cache_new (REPLY_CACHE_LIMIT, REPLY_CACHE_WINDOW);
 
     zsock_signal (pipe, 0);
 
@@ -94,23 +453,26 @@ fty_metric_cache_server (zsock_t *pipe, void *args)
     uint64_t timeout = (uint64_t) POLL_INTERVAL;
 
     while (!zsys_interrupted) {
-        void *which = zpoller_wait (poller, timeout);
+        // with metrics waiting, only look for what else came in; with
+        // replies waiting, come back soon to see if they can be sent
+        bool queued = zlistx_size (scheduler.ingest) > 0;
+        int wait = (int) timeout;
+        if (queued)
+            wait = 0;
+        else
+        if (outbox_size (outbox) > 0)
+            wait = OUTBOX_RETRY;
+        void *which = zpoller_wait (poller, wait);
 
-        if (which == NULL) {
-            if (zpoller_terminated (poller) || zsys_interrupted) {
-                log_warning ("zpoller_terminated () or zsys_interrupted");
-                break;
-            }
-            if (zpoller_expired (poller)) {
-                s_handle_poll (data);
-            }
-            timestamp = (uint64_t) zclock_mono ();
-            continue;
+        if (which == NULL && (zpoller_terminated (poller) || zsys_interrupted)) {
+            log_warning ("zpoller_terminated () or zsys_interrupted");
+            break;
         }
 
+        // once per wakeup rather than once per message
         uint64_t now = (uint64_t) zclock_mono ();
-        if (now - timestamp >= timeout) {
-            s_handle_poll (data);
+        if ((which == NULL && wait == (int) timeout && zpoller_expired (poller)) || now - timestamp >= timeout) {
+            s_handle_poll (data, &scheduler, outbox, cache);
             timestamp = (uint64_t) zclock_mono ();
         }
 
@@ -120,42 +482,82 @@ fty_metric_cache_server (zsock_t *pipe, void *args)
                 log_error ("Given `which == pipe`, function `zmsg_recv (pipe)` returned NULL");
                 continue;
             }
+            if (s_scheduler_command (&scheduler, &message))
+                continue;
+            if (s_socket_command ("ROUTER", ZMQ_ROUTER, &router, poller, &message))
+                continue;
+            if (s_socket_command ("PULL", ZMQ_PULL, &pull, poller, &message))
+                continue;
             if (actor_commands (client, &message, data, &fullpath) == 1) {
                 break;
             }
             continue;
         }
 
+        if (which && which == router) {
+            s_handle_router (router, data, cache);
+            which = NULL;
+        }
+        if (which && which == pull) {
+            s_handle_pull (pull, &scheduler);
+            which = NULL;
+        }
+
         // paranoid non-destructive assertion of a twisted mind
-        if (which != mlm_client_msgpipe (client)) {
+        if (which != NULL && which != mlm_client_msgpipe (client)) {
             log_fatal ("which was checked for NULL, pipe and now should have been `mlm_client_msgpipe (client)` but is not.");
             continue;
         }
 
-        zmsg_t *message = mlm_client_recv (client);
-        if (!message) {
-            log_error ("Given `which == mlm_client_msgpipe (client)`, function `mlm_client_recv ()` returned NULL");
-            continue;
-        }
+        // drain what is already queued, the bound keeps the actor pipe and
+        // the purge timer responsive under sustained load. Receiving goes on
+        // when too many metrics wait, requests behind them in the pipe would
+        // wait too; the oldest metric is stored instead to make room.
+        zsock_t *msgpipe = mlm_client_msgpipe (client);
+        for (int handled = 0; which && handled < DRAIN_BATCH; handled++) {
+            if (handled > 0 && !(zsock_events (msgpipe) & ZMQ_POLLIN))
+                break;
 
-        const char *command = mlm_client_command (client);
-        if (streq (command, "STREAM DELIVER")) {
-            s_handle_stream (client, &message, data);
-        }
-        else
-        if (streq (command, "MAILBOX DELIVER")) {
-            s_handle_mailbox (client, &message, data);
-        }
-        else
-        if (streq (command, "SERVICE DELIVER")) {
-            s_handle_service (client, &message);
-        }
-        else {
-            log_error ("Unrecognized mlm_client_command () = '%s'", command ? command : "(null)");
+            zmsg_t *message = mlm_client_recv (client);
+            if (!message) {
+                log_error ("Given `which == mlm_client_msgpipe (client)`, function `mlm_client_recv ()` returned NULL");
+                break;
+            }
+
+            const char *command = mlm_client_command (client);
+            if (streq (command, "STREAM DELIVER")) {
+                if (zlistx_size (scheduler.ingest) >= scheduler.limit) {
+                    s_store_oldest (&scheduler, data);
+                    scheduler.overflows++;
+                }
+                s_queue_ingest (&scheduler, &message);
+            }
+            else
+            if (streq (command, "MAILBOX DELIVER")) {
+                s_handle_mailbox (client, &message, data, outbox, cache);
+            }
+            else
+            if (streq (command, "SERVICE DELIVER")) {
+                s_handle_service (client, &message, data, outbox, cache);
+            }
+            else {
+                log_error ("Unrecognized mlm_client_command () = '%s'", command ? command : "(null)");
+            }
+            zmsg_destroy (&message);
         }
-        zmsg_destroy (&message);
+
+        s_store_queued (&scheduler, data, scheduler.budget);
+        outbox_flush (outbox, client);
     } // while (!zsys_interrupted)
 
+    // nothing received is lost on exit
+    s_store_queued (&scheduler, data, -1);
+    zlistx_destroy (&scheduler.ingest);
+    outbox_flush (outbox, client);
+    outbox_destroy (&outbox);
+    reply_cache_destroy (&cache);
+    zsock_destroy (&router);
+    zsock_destroy (&pull);
     rt_save (data, fullpath);
     rt_destroy (&data);
     zstr_free (&fullpath);
@@ -209,6 +611,11 @@ fty_metric_cache_server_test (bool verbose)
     zactor_t *rt = zactor_new (fty_metric_cache_server, (void*) NULL);
     zstr_sendx (rt, "CONNECT", endpoint, "agent-rt", NULL);
     zstr_sendx (rt, "CONSUMER", "METRICS", ".*", NULL);
+    zstr_sendx (rt, "CONSUMER", "ASSETS", ".*", NULL);
+    zstr_sendx (rt, "WORKER", "metric-cache", RFC_RT_DATA_SUBJECT, NULL);
+    zstr_sendx (rt, "SCHEDULE", "5", "1000", NULL);
+    zstr_sendx (rt, "ROUTER", "inproc://fty-metric-cache-server-test-router", NULL);
+    zstr_sendx (rt, "PULL", "inproc://fty-metric-cache-server-test-pull", NULL);
     zclock_sleep (100);
 
     zmsg_t *msg = fty_proto_encode_metric (NULL, time (NULL), 5, "temperature", "ups", "30", "C");
@@ -620,6 +1027,254 @@ fty_metric_cache_server_test (bool verbose)
     zmsg_destroy (&reply);
     }
 
+    // ===============================================
+    // Test case #8:
+    //      1. Delete ups-1
+    //      2. GET ups-1
+    // Expected:
+    //      0 measurements
+    // ===============================================
+    {
+    mlm_client_t *assets = mlm_client_new ();
+    mlm_client_connect (assets, endpoint, 1000, "ASSETS-PRODUCER");
+    mlm_client_set_producer (assets, "ASSETS");
+
+    msg = fty_proto_encode_asset (NULL, "ups-1", FTY_PROTO_ASSET_OP_DELETE, NULL);
+    rv = mlm_client_send (assets, "Nobody here cares about this.", &msg);
+    assert (rv == 0);
+    zclock_sleep (100);
+
+    zmsg_t *send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "GET");
+    zmsg_addstr (send, "ups-1");
+    rv = mlm_client_sendto (ui, "agent-rt", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+    zmsg_t *reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (streq (mlm_client_subject (ui), RFC_RT_DATA_SUBJECT));
+    zmsg_print (reply);
+    assert (zmsg_size (reply) == 3);
+    zmsg_destroy (&reply);
+
+    mlm_client_destroy (&assets);
+    }
+
+    // ===============================================
+    // Test case #9:
+    //      GET sensor-9 through the service
+    // Expected:
+    //      1 measurement, sent to the mailbox of requester
+    // ===============================================
+    {
+    msg = fty_proto_encode_metric (NULL, time (NULL), 60, "temperature", "sensor-9", "21", "C");
+    rv = mlm_client_send (producer, "Nobody here cares about this.", &msg);
+    assert (rv == 0);
+    zclock_sleep (100);
+
+    zmsg_t *send = zmsg_new ();
+    zmsg_addstr (send, "67890");
+    zmsg_addstr (send, "GET");
+    zmsg_addstr (send, "sensor-9");
+    rv = mlm_client_sendfor (ui, "metric-cache", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+    zmsg_t *reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (streq (mlm_client_command (ui), "MAILBOX DELIVER"));
+    assert (streq (mlm_client_sender (ui), "agent-rt"));
+    assert (streq (mlm_client_subject (ui), RFC_RT_DATA_SUBJECT));
+    assert (zmsg_size (reply) == 4);
+    char *uuid = zmsg_popstr (reply);
+    assert (streq (uuid, "67890"));
+    zstr_free (&uuid);
+    zmsg_destroy (&reply);
+    }
+
+    // ===============================================
+    // Test case #10:
+    //      LIST, GET sensor-9 and MGET sensor-9 pipelined on ROUTER endpoint
+    // Expected:
+    //      replies in order
+    // ===============================================
+    {
+    zsock_t *dealer = zsock_new_dealer ("inproc://fty-metric-cache-server-test-router");
+    assert (dealer);
+    const char *commands [] = { "LIST", "GET", "MGET" };
+    for (int i = 0; i < 3; i++) {
+        zmsg_t *send = zmsg_new ();
+        zmsg_addstrf (send, "%d", i);
+        zmsg_addstr (send, commands [i]);
+        if (i > 0)
+            zmsg_addstr (send, "sensor-9");
+        rv = zmsg_send (&send, dealer);
+        assert (rv == 0);
+    }
+    for (int i = 0; i < 3; i++) {
+        zmsg_t *reply = zmsg_recv (dealer);
+        assert (reply);
+        zmsg_print (reply);
+        char *uuid = zmsg_popstr (reply);
+        assert (atoi (uuid) == i);
+        zstr_free (&uuid);
+        char *ok = zmsg_popstr (reply);
+        assert (streq (ok, "OK"));
+        zstr_free (&ok);
+        assert (zmsg_size (reply) == (i == 2 ? 4 : 2));
+        zmsg_destroy (&reply);
+    }
+    zsock_destroy (&dealer);
+    }
+
+    // ===============================================
+    // Test case #11:
+    //      PUSH metric of sensor-11 to PULL endpoint, GET sensor-11
+    // Expected:
+    //      1 measurement
+    // ===============================================
+    {
+    zsock_t *push = zsock_new_push ("inproc://fty-metric-cache-server-test-pull");
+    assert (push);
+    msg = fty_proto_encode_metric (NULL, time (NULL), 60, "temperature", "sensor-11", "19", "C");
+    rv = zmsg_send (&msg, push);
+    assert (rv == 0);
+    zclock_sleep (100);
+
+    zmsg_t *send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "GET");
+    zmsg_addstr (send, "sensor-11");
+    rv = mlm_client_sendto (ui, "agent-rt", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+    zmsg_t *reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 4);
+    zmsg_destroy (&reply);
+    zsock_destroy (&push);
+    }
+
+    // ===============================================
+    // Test case #12:
+    //      publish batch of 2 metrics of pdu-12, GET pdu-12
+    // Expected:
+    //      2 measurements
+    // ===============================================
+    {
+    msg = zmsg_new ();
+    zmsg_addstr (msg, FTY_METRIC_CACHE_BATCH);
+    zmsg_addstr (msg, "pdu-12");
+    zmsg_addstrf (msg, "%" PRIu64, (uint64_t) time (NULL));
+    zmsg_addstr (msg, "realpower.outlet.1");
+    zmsg_addstr (msg, "10");
+    zmsg_addstr (msg, "W");
+    zmsg_addstr (msg, "60");
+    zmsg_addstr (msg, "realpower.outlet.2");
+    zmsg_addstr (msg, "20");
+    zmsg_addstr (msg, "W");
+    zmsg_addstr (msg, "60");
+    rv = mlm_client_send (producer, "Nobody here cares about this.", &msg);
+    assert (rv == 0);
+    zclock_sleep (100);
+
+    zmsg_t *send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "GET");
+    zmsg_addstr (send, "pdu-12");
+    rv = mlm_client_sendto (ui, "agent-rt", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+    zmsg_t *reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 5);
+    for (int i = 0; i < 3; i++) {
+        char *frame = zmsg_popstr (reply);
+        zstr_free (&frame);
+    }
+    encoded = zmsg_popmsg (reply);
+    proto = fty_proto_decode (&encoded);
+    assert (streq (fty_proto_name (proto), "pdu-12"));
+    assert (fty_proto_ttl (proto) == 60);
+    fty_proto_destroy (&proto);
+    zmsg_destroy (&reply);
+    }
+
+    // ===============================================
+    // Test case #13:
+    //      1. Place ups-13 in rack-13, publish its realpower
+    //      2. Publish inventory of ups-13, without parents
+    //      3. GET rack-13
+    // Expected:
+    //      the total of rack-13 stays
+    // ===============================================
+    {
+    zstr_sendx (rt, "TOPOLOGY", "realpower\\.default", NULL);
+    mlm_client_t *assets = mlm_client_new ();
+    mlm_client_connect (assets, endpoint, 1000, "ASSETS-PRODUCER-13");
+    mlm_client_set_producer (assets, "ASSETS");
+
+    zhash_t *aux = zhash_new ();
+    zhash_autofree (aux);
+    zhash_insert (aux, "parent_name.1", (void *) "rack-13");
+    msg = fty_proto_encode_asset (aux, "ups-13", FTY_PROTO_ASSET_OP_CREATE, NULL);
+    zhash_destroy (&aux);
+    rv = mlm_client_send (assets, "Nobody here cares about this.", &msg);
+    assert (rv == 0);
+    zclock_sleep (100);
+    msg = fty_proto_encode_metric (NULL, time (NULL), 60, "realpower.default", "ups-13", "100", "W");
+    rv = mlm_client_send (producer, "Nobody here cares about this.", &msg);
+    assert (rv == 0);
+    zclock_sleep (100);
+
+    for (int step = 0; step < 2; step++) {
+        if (step == 1) {
+            msg = fty_proto_encode_asset (NULL, "ups-13", FTY_PROTO_ASSET_OP_INVENTORY, NULL);
+            rv = mlm_client_send (assets, "Nobody here cares about this.", &msg);
+            assert (rv == 0);
+            zclock_sleep (100);
+        }
+        zmsg_t *send = zmsg_new ();
+        zmsg_addstr (send, "12345");
+        zmsg_addstr (send, "GET");
+        zmsg_addstr (send, "rack-13");
+        rv = mlm_client_sendto (ui, "agent-rt", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+        assert (rv == 0);
+        zmsg_t *reply = mlm_client_recv (ui);
+        assert (reply);
+        assert (zmsg_size (reply) == 4);
+        zmsg_destroy (&reply);
+    }
+    mlm_client_destroy (&assets);
+    }
+
+    // ===============================================
+    // Test case #14:
+    //      1. Publish three metrics of ups-14, one of sensor-14, one of ups-14
+    //      2. GET ups-14, GET sensor-14
+    // Expected:
+    //      4 measurements of ups-14, 1 of sensor-14, runs of metrics of one
+    //      element are stored together
+    // ===============================================
+    {
+    const char *elements [] = { "ups-14", "ups-14", "ups-14", "sensor-14", "ups-14" };
+    const char *types [] = { "load.default", "voltage.output", "current.output", "temperature", "realpower.default" };
+    for (int i = 0; i < 5; i++) {
+        msg = fty_proto_encode_metric (NULL, time (NULL), 60, types [i], elements [i], "1", "");
+        rv = mlm_client_send (producer, "Nobody here cares about this.", &msg);
+        assert (rv == 0);
+    }
+    zclock_sleep (100);
+
+    for (int i = 0; i < 2; i++) {
+        zmsg_t *send = zmsg_new ();
+        zmsg_addstr (send, "12345");
+        zmsg_addstr (send, "GET");
+        zmsg_addstr (send, i == 0 ? "ups-14" : "sensor-14");
+        rv = mlm_client_sendto (ui, "agent-rt", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+        assert (rv == 0);
+        zmsg_t *reply = mlm_client_recv (ui);
+        assert (reply);
+        assert (zmsg_size (reply) == (i == 0 ? 3 + 4 : 3 + 1));
+        zmsg_destroy (&reply);
+    }
+    }
 
     zactor_destroy (&rt);
     mlm_client_destroy (&ui);
@@ -29,7 +29,12 @@
 #include "fty_metric_cache_classes.h"
 
 #define ENDPOINT "ipc://@/malamute"
-static void dump_hash_of_metrics(zhashx_t *hash, zmsg_t *reply,char *filter){
+
+//  Append current metrics of hash with type matching 'filter' to reply,
+//  lowering '*expiry_p' (unless NULL, 0 for none) to the time when the first
+//  of them expires
+
+static void dump_hash_of_metrics(zhashx_t *hash, zmsg_t *reply,const char *filter, uint64_t *expiry_p){
     uint64_t now_s = time(NULL);
     zrex_t *rex=NULL;
     if(filter!=NULL){
@@ -40,16 +45,19 @@ static void dump_hash_of_metrics(zhashx_t *hash, zmsg_t *reply,char *filter){
          }
     }
     if (hash) {
-        fty_proto_t *metric = (fty_proto_t *) zhashx_first (hash);
+        rt_metric_t *metric = (rt_metric_t *) zhashx_first (hash);
         while (metric) {
-            if ( fty_proto_time(metric) + fty_proto_ttl(metric) > now_s ) {
-                if(NULL==rex || zrex_matches(rex,fty_proto_type(metric))){
-                    fty_proto_t *copy = fty_proto_dup (metric);
+            if ( fty_proto_time(metric->proto) + fty_proto_ttl(metric->proto) > now_s ) {
+                if(NULL==rex || zrex_matches(rex,fty_proto_type(metric->proto))){
+                    uint64_t expiry = fty_proto_time (metric->proto) + fty_proto_ttl (metric->proto);
+                    if (expiry_p && (*expiry_p == 0 || expiry < *expiry_p))
+                        *expiry_p = expiry;
+                    fty_proto_t *copy = fty_proto_dup (metric->proto);
                     zmsg_t *encoded = fty_proto_encode (&copy);
                     zmsg_addmsg (reply, &encoded);
                 }
             }
-            metric = (fty_proto_t *) zhashx_next (hash);
+            metric = (rt_metric_t *) zhashx_next (hash);
         }
     }
     if(NULL!=rex){
@@ -57,10 +65,277 @@ static void dump_hash_of_metrics(zhashx_t *hash, zmsg_t *reply,char *filter){
     }
 }
 
+//  Append copy of metric to reply unless its TTL ran out
+
+static void
+s_add_metric (zmsg_t *reply, fty_proto_t *metric, uint64_t now_s)
+{
+    if (fty_proto_time (metric) + fty_proto_ttl (metric) <= now_s)
+        return;
+    fty_proto_t *copy = fty_proto_dup (metric);
+    zmsg_t *encoded = fty_proto_encode (&copy);
+    zmsg_addmsg (reply, &encoded);
+}
+
+//  Append metrics of one measurement to reply, keeping only elements which
+//  match 'pattern' (all when NULL). The index gives us the candidates
+//  directly, so the cost is proportional to the number of matches.
+
+static void
+s_dump_type (rt_t *data, const char *type, zmsg_t *reply, const char *pattern)
+{
+    uint64_t now_s = (uint64_t) time (NULL);
+    zlistx_t *metrics = rt_select_type (data, type, pattern);
+    rt_metric_t *metric = (rt_metric_t *) zlistx_first (metrics);
+    while (metric) {
+        s_add_metric (reply, metric->proto, now_s);
+        metric = (rt_metric_t *) zlistx_next (metrics);
+    }
+    zlistx_destroy (&metrics);
+}
+
+//  Min-heap of records by numeric value, keeps the 'capacity' largest ones
+
+typedef struct {
+    rt_metric_t **items;
+    size_t size;
+    size_t capacity;
+} s_heap_t;
+
+static void
+s_heap_sift_down (s_heap_t *heap, size_t index)
+{
+    while (true) {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < heap->size && heap->items [left]->value < heap->items [smallest]->value)
+            smallest = left;
+        if (right < heap->size && heap->items [right]->value < heap->items [smallest]->value)
+            smallest = right;
+        if (smallest == index)
+            return;
+        rt_metric_t *swap = heap->items [index];
+        heap->items [index] = heap->items [smallest];
+        heap->items [smallest] = swap;
+        index = smallest;
+    }
+}
+
+static void
+s_heap_offer (s_heap_t *heap, rt_metric_t *metric)
+{
+    if (heap->size < heap->capacity) {
+        size_t index = heap->size++;
+        heap->items [index] = metric;
+        // sift up
+        while (index > 0) {
+            size_t parent = (index - 1) / 2;
+            if (heap->items [parent]->value <= heap->items [index]->value)
+                break;
+            rt_metric_t *swap = heap->items [index];
+            heap->items [index] = heap->items [parent];
+            heap->items [parent] = swap;
+            index = parent;
+        }
+    }
+    else
+    if (metric->value > heap->items [0]->value) {
+        heap->items [0] = metric;
+        s_heap_sift_down (heap, 0);
+    }
+}
+
+//  Append 'k' metrics with the highest numeric values to reply, highest first
+
+static void
+s_dump_topk (zlistx_t *metrics, size_t k, zmsg_t *reply)
+{
+    uint64_t now_s = (uint64_t) time (NULL);
+    s_heap_t heap;
+    heap.size = 0;
+    heap.capacity = k < zlistx_size (metrics) ? k : zlistx_size (metrics);
+    if (heap.capacity == 0)
+        return;
+    heap.items = (rt_metric_t **) zmalloc (heap.capacity * sizeof (rt_metric_t *));
+    assert (heap.items);
+
+    rt_metric_t *metric = (rt_metric_t *) zlistx_first (metrics);
+    while (metric) {
+        if (!isnan (metric->value))
+            s_heap_offer (&heap, metric);
+        metric = (rt_metric_t *) zlistx_next (metrics);
+    }
+
+    // popping the minimum fills the array from the end, i.e. sorts it descending
+    size_t count = heap.size;
+    while (heap.size > 1) {
+        rt_metric_t *minimum = heap.items [0];
+        heap.items [0] = heap.items [--heap.size];
+        heap.items [heap.size] = minimum;
+        s_heap_sift_down (&heap, 0);
+    }
+    for (size_t i = 0; i < count; i++)
+        s_add_metric (reply, heap.items [i]->proto, now_s);
+    free (heap.items);
+}
+
+//  Append metrics with numeric value within [minimum, maximum] to reply
+
+static void
+s_dump_range (zlistx_t *metrics, double minimum, double maximum, zmsg_t *reply)
+{
+    uint64_t now_s = (uint64_t) time (NULL);
+    rt_metric_t *metric = (rt_metric_t *) zlistx_first (metrics);
+    while (metric) {
+        if (metric->value >= minimum && metric->value <= maximum)
+            s_add_metric (reply, metric->proto, now_s);
+        metric = (rt_metric_t *) zlistx_next (metrics);
+    }
+}
+
+//  Parse bound of RANGE, empty string means unbounded.
+//  Returns -1 if 'string' is not a number.
+
+static int
+s_parse_bound (const char *string, double unbounded, double *bound)
+{
+    if (streq (string, "")) {
+        *bound = unbounded;
+        return 0;
+    }
+    char *end = NULL;
+    *bound = strtod (string, &end);
+    return (end == string || *end != '\0' || isnan (*bound)) ? -1 : 0;
+}
+
+//  Aggregate numeric values of 'metrics' by 'operation' into reply
+//  value/count/oldest, where 'count' is the number of numeric samples and
+//  'oldest' is the time of the oldest one. Returns -1 for unknown operation.
+
+static int
+s_aggregate (zlistx_t *metrics, const char *operation, zmsg_t *reply)
+{
+    double sum = 0, min = NAN, max = NAN;
+    uint64_t count = 0;
+    uint64_t oldest = 0;
+
+    rt_metric_t *metric = (rt_metric_t *) zlistx_first (metrics);
+    while (metric) {
+        if (!isnan (metric->value)) {
+            uint64_t time_s = fty_proto_time (metric->proto);
+            sum += metric->value;
+            if (count == 0 || metric->value < min)
+                min = metric->value;
+            if (count == 0 || metric->value > max)
+                max = metric->value;
+            if (count == 0 || time_s < oldest)
+                oldest = time_s;
+            count++;
+        }
+        metric = (rt_metric_t *) zlistx_next (metrics);
+    }
+
+    double value;
+    if (streq (operation, "sum"))
+        value = sum;
+    else
+    if (streq (operation, "avg"))
+        value = count ? sum / count : NAN;
+    else
+    if (streq (operation, "min"))
+        value = min;
+    else
+    if (streq (operation, "max"))
+        value = max;
+    else
+    if (streq (operation, "count"))
+        value = (double) count;
+    else
+        return -1;
+
+    zmsg_addstrf (reply, "%.15g", value);
+    zmsg_addstrf (reply, "%" PRIu64, count);
+    zmsg_addstrf (reply, "%" PRIu64, oldest);
+    return 0;
+}
+
+//  Send reply to the sender of the request, through 'outbox' unless NULL
+
+static void
+s_send_reply (mlm_client_t *client, outbox_t *outbox, zmsg_t **reply_p)
+{
+    if (outbox) {
+        outbox_send (outbox, mlm_client_sender (client), RFC_RT_DATA_SUBJECT, reply_p);
+        return;
+    }
+    int rv = mlm_client_sendto (client, mlm_client_sender (client), RFC_RT_DATA_SUBJECT, NULL, 5000, reply_p);
+    if (rv != 0) {
+        log_error (
+                "mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.",
+                mlm_client_sender (client), RFC_RT_DATA_SUBJECT);
+    }
+}
+
+//  Share body of reply with identical requests when 'key' is given, return
+//  the reply taking ownership
+
+static zmsg_t *
+s_keep_reply (reply_cache_t *cache, const char *key, zmsg_t **reply_p)
+{
+    if (cache && key) {
+        zmsg_t *body = zmsg_dup (*reply_p);
+        zframe_t *uuid = zmsg_pop (body);
+        zframe_destroy (&uuid);
+        reply_cache_put (cache, key, &body);
+    }
+    zmsg_t *reply = *reply_p;
+    *reply_p = NULL;
+    return reply;
+}
+
+//  Append current metrics of element (or elements matching it) with type
+//  matching 'filter' to reply, names of all devices it matches are added to
+//  'devices', '*expiry_p' is lowered as by dump_hash_of_metrics. Returns true
+//  when totals of the topology were dumped.
+
+static bool
+s_dump_element (rt_t *data, const char *element, const char *filter, zmsg_t *reply, zlistx_t *devices, uint64_t *expiry_p)
+{
+    zhashx_t *hash = rt_get_element (data, element);
+    // sums of measurements of its descendants, e.g. for a rack
+    zhashx_t *totals = rt_get_totals (data, element);
+    if(hash!=NULL || totals!=NULL){
+        dump_hash_of_metrics(hash,reply,filter,expiry_p);
+        dump_hash_of_metrics(totals,reply,filter,expiry_p);
+        zlistx_add_end (devices, (void *) element);
+    }else if (rt_is_pattern (element)) {
+        // encoded straight from the records, nothing changes them meanwhile
+        char *anchored = zsys_sprintf ("^%s$", element);
+        zrex_t *rex = zrex_new (anchored);
+        zstr_free (&anchored);
+        if (zrex_valid (rex)) {
+            rt_device_t *device = (rt_device_t *) zhashx_first (data->devices);
+            while (device) {
+                const char *name = (const char *) zhashx_cursor (data->devices);
+                // covered even when none of its metrics is current, so
+                // that its next update makes a cached reply stale
+                if (zrex_matches (rex, name)) {
+                    dump_hash_of_metrics (device->metrics, reply, filter, expiry_p);
+                    zlistx_add_end (devices, (void *) name);
+                }
+                device = (rt_device_t *) zhashx_next (data->devices);
+            }
+        }
+        zrex_destroy (&rex);
+    }
+    return totals != NULL;
+}
+
 //  --------------------------------------------------------------------------
 //  Perform mailbox deliver protocol
 void
-mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data)
+mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data, outbox_t *outbox, reply_cache_t *cache)
 {
     assert (client);
     assert (msg_p);
@@ -68,7 +343,6 @@ mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data)
 
     if (!*msg_p)
         return;
-    zmsg_t *msg = *msg_p;
 
     // check subject
     if (!streq (mlm_client_subject (client), RFC_RT_DATA_SUBJECT)) {
@@ -78,6 +352,25 @@ mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data)
                 mlm_client_sender (client), mlm_client_subject (client));
         return;
     }
+    zmsg_t *reply = mailbox_reply (mlm_client_sender (client), msg_p, data, cache);
+    if (reply)
+        s_send_reply (client, outbox, &reply);
+}
+
+//  --------------------------------------------------------------------------
+//  Compute reply to request
+zmsg_t *
+mailbox_reply (const char *sender, zmsg_t **msg_p, rt_t *data, reply_cache_t *cache)
+{
+    assert (sender);
+    assert (msg_p);
+    assert (data);
+
+    if (!*msg_p)
+        return NULL;
+    zmsg_t *msg = *msg_p;
+    zmsg_t *result = NULL;
+
     // check uuid
     char *uuid = zmsg_popstr (msg);
     if (!uuid) {
@@ -85,8 +378,23 @@ mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data)
         log_warning (
                 "Bad message. Expected multipart string message `uuid/...`"
                 " - 'uuid' field is missing. Sender: '%s', Subject: '%s'.",
-                mlm_client_sender (client), mlm_client_subject (client));
-        return;
+                sender, RFC_RT_DATA_SUBJECT);
+        return NULL;
+    }
+    // identical requests share the reply, except for statistics which
+    // change with every metric received
+    char *key = NULL;
+    if (cache && zmsg_size (msg) > 0 && !zframe_streq (zmsg_first (msg), "STATS")) {
+        key = reply_cache_key (msg);
+        // refreshes change time and ttl in replies, so they count too
+        result = reply_cache_get (cache, key, rt_get_update_generation (data));
+        if (result) {
+            zmsg_pushstr (result, uuid);
+            zstr_free (&key);
+            zstr_free (&uuid);
+            zmsg_destroy (msg_p);
+            return result;
+        }
     }
     // check command
     char *command = zmsg_popstr (msg);
@@ -94,10 +402,10 @@ mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data)
         zmsg_destroy (msg_p);
         zstr_free (&uuid);
         log_warning (
-                "Bad message. Expected multipart string message `uuid/(GET|LIST)...`"
-                " - 'GET/LIST' string is missing. Sender: '%s', Subject: '%s'.",
-                mlm_client_sender (client), mlm_client_subject (client));
-        return;
+                "Bad message. Expected multipart string message `uuid/(GET|MGET|GETTYPE|AGG|TOPK|RANGE|INFO|HISTORY|ROLLUP|STATS|LIST)...`"
+                " - command string is missing. Sender: '%s', Subject: '%s'.",
+                sender, RFC_RT_DATA_SUBJECT);
+        return NULL;
     }
 
     if (streq (command, "LIST")) {
@@ -106,84 +414,310 @@ mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data)
         zmsg_addstr (send, uuid);
         zmsg_addstr (send, "OK");
         zmsg_addstr (send, command);
-        zmsg_addstr (send, rt_get_list_devices(data));
+        zmsg_addstr (send, rt_get_list_devices (data));
 
-        int rv = mlm_client_sendto (client, mlm_client_sender(client), RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
-        if ( rv != 0 ) {
-            log_error (
-                    "mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.",
-                    mlm_client_sender (client), RFC_RT_DATA_SUBJECT);
-        }
+        result = s_keep_reply (cache, key, &send);
     } else if(streq (command, "GET")) {
         // check element
         char *element = zmsg_popstr (msg);
         if (!element) {
             zstr_free (&command);
             zstr_free (&uuid);
+            zstr_free (&key);
             zmsg_destroy (msg_p);
             log_warning (
                     "Bad message. Expected multipart string message `uuid/GET/element`"
                     " - 'element' is missing. Sender: '%s', Subject: '%s'.",
-                    mlm_client_sender (client), mlm_client_subject (client));
-            return;
+                    sender, RFC_RT_DATA_SUBJECT);
+            return NULL;
         }
         //check optional filter
         char *filter=zmsg_popstr(msg);
+        // unchanged devices are not dumped again
+        zmsg_t *reply = (cache && key) ? reply_cache_lookup (cache, key, data) : NULL;
+        if (reply) {
+            zmsg_pushstr (reply, uuid);
+            result = s_keep_reply (cache, key, &reply);
+        }
+        else {
+            reply = zmsg_new ();
+            zmsg_addstr (reply, uuid);
+            zmsg_addstr (reply, "OK");
+            zmsg_addstr (reply, element);
+            // names of devices the reply covers
+            zlistx_t *devices = zlistx_new ();
+            zlistx_set_duplicator (devices, (czmq_duplicator *) strdup);
+            zlistx_set_destructor (devices, (czmq_destructor *) zstr_free);
+            uint64_t expiry = 0;
+            bool totals = s_dump_element (data, element, filter, reply, devices, &expiry);
+            // totals change with devices elsewhere in the topology
+            if (cache && key && !totals) {
+                zmsg_t *body = zmsg_dup (reply);
+                zframe_t *frame = zmsg_pop (body);
+                zframe_destroy (&frame);
+                reply_cache_store (cache, key, data, devices, expiry, &body);
+            }
+            zlistx_destroy (&devices);
+            result = s_keep_reply (cache, key, &reply);
+        }
+        zstr_free (&element);
+        zstr_free (&filter);
+    } else if (streq (command, "MGET")) {
         zmsg_t *reply = zmsg_new ();
         zmsg_addstr (reply, uuid);
         zmsg_addstr (reply, "OK");
-        zmsg_addstr (reply, element);
-        zhashx_t *hash = rt_get_element (data, element);
-        if(hash!=NULL){
-            dump_hash_of_metrics(hash,reply,filter);
-        }else{
-            //trying to process element as a regex ..
-            //enforce regex
-            char *element_regex = (char*) malloc(strlen(element)+3);
-            sprintf(element_regex,"^%s$",element);
-            zrex_t *rex = zrex_new (element_regex);
-            if(zrex_valid(rex)){
-                zlist_t* device_name_lst=zlist_new();
-                zhashx_t *device = (zhashx_t *) zhashx_first (data->devices);
-                //loop on device list
-                while (device) {
-                    char* device_name=(char *) zhashx_cursor (data->devices);
-                    zlist_push(device_name_lst,(void*)device_name);
-                    device = (zhashx_t *) zhashx_next (data->devices);
-                }
-                char*device_name = (char *) zlist_first (device_name_lst);
-                //loop on device_name list
-                while (device_name) {
-                    if(zrex_matches(rex,device_name)){
-                        //regex match !
-                        dump_hash_of_metrics(rt_get_element (data, device_name),reply,filter);
-                    }
-                    device_name = (char *) zlist_next (device_name_lst);
-                }
-                zlist_destroy(&device_name_lst);
+        zmsg_addstr (reply, command);
+        zlistx_t *devices = zlistx_new ();
+        zlistx_set_duplicator (devices, (czmq_duplicator *) strdup);
+        zlistx_set_destructor (devices, (czmq_destructor *) zstr_free);
+        char *element = zmsg_popstr (msg);
+        while (element) {
+            zmsg_t *metrics = zmsg_new ();
+            s_dump_element (data, element, NULL, metrics, devices, NULL);
+            zmsg_addstr (reply, element);
+            zmsg_addstrf (reply, "%zu", zmsg_size (metrics));
+            zframe_t *frame = zmsg_pop (metrics);
+            while (frame) {
+                zmsg_append (reply, &frame);
+                frame = zmsg_pop (metrics);
             }
-            zrex_destroy(&rex);
-            free(element_regex);
+            zmsg_destroy (&metrics);
+            zstr_free (&element);
+            element = zmsg_popstr (msg);
+        }
+        zlistx_destroy (&devices);
+        result = s_keep_reply (cache, key, &reply);
+    } else if (streq (command, "GETTYPE")) {
+        char *type = zmsg_popstr (msg);
+        if (!type) {
+            zstr_free (&command);
+            zstr_free (&uuid);
+            zstr_free (&key);
+            zmsg_destroy (msg_p);
+            log_warning (
+                    "Bad message. Expected multipart string message `uuid/GETTYPE/type`"
+                    " - 'type' is missing. Sender: '%s', Subject: '%s'.",
+                    sender, RFC_RT_DATA_SUBJECT);
+            return NULL;
+        }
+        // optional element pattern
+        char *pattern = zmsg_popstr (msg);
+
+        zmsg_t *reply = zmsg_new ();
+        zmsg_addstr (reply, uuid);
+        zmsg_addstr (reply, "OK");
+        zmsg_addstr (reply, type);
+        s_dump_type (data, type, reply, pattern);
+        zstr_free (&pattern);
+        zstr_free (&type);
+
+        result = s_keep_reply (cache, key, &reply);
+    } else if (streq (command, "AGG")) {
+        char *operation = zmsg_popstr (msg);
+        char *element = zmsg_popstr (msg);
+        char *type = zmsg_popstr (msg);
+        zmsg_t *reply = zmsg_new ();
+        zmsg_addstr (reply, uuid);
+        zmsg_addstr (reply, "OK");
+        zmsg_addstr (reply, operation ? operation : "");
+
+        zlistx_t *metrics = NULL;
+        if (operation && element && type)
+            metrics = rt_select (data, element, type);
+        if (!metrics || s_aggregate (metrics, operation, reply) == -1) {
+            log_warning (
+                    "Bad message. Expected multipart string message `uuid/AGG/(sum|avg|min|max|count)/element/type`."
+                    " Sender: '%s', Subject: '%s'.",
+                    sender, RFC_RT_DATA_SUBJECT);
+            zmsg_destroy (&reply);
         }
+        zlistx_destroy (&metrics);
+        zstr_free (&type);
         zstr_free (&element);
-        if(filter!=NULL)zstr_free (&filter);
+        zstr_free (&operation);
 
-        int rv = mlm_client_sendto (client, mlm_client_sender(client), RFC_RT_DATA_SUBJECT, NULL, 5000, &reply);
+        if (reply)
+            result = s_keep_reply (cache, key, &reply);
+    } else if (streq (command, "TOPK") || streq (command, "RANGE")) {
+        bool topk = streq (command, "TOPK");
+        char *type = zmsg_popstr (msg);
+        char *first = zmsg_popstr (msg);
+        char *second = topk ? NULL : zmsg_popstr (msg);
+        // optional element pattern
+        char *pattern = zmsg_popstr (msg);
 
-        if (rv != 0) {
-            log_error (
-                    "mlm_client_sendto (sender = '%s', subject = '%s', timeout = '5000') failed.",
-                    mlm_client_sender (client), RFC_RT_DATA_SUBJECT);
+        long k = 0;
+        double minimum = 0, maximum = 0;
+        bool valid = type && first && (topk || second);
+        if (valid && topk) {
+            char *end = NULL;
+            k = strtol (first, &end, 10);
+            valid = end != first && *end == '\0' && k > 0;
         }
+        if (valid && !topk) {
+            valid = s_parse_bound (first, -INFINITY, &minimum) == 0
+                &&  s_parse_bound (second, INFINITY, &maximum) == 0;
+        }
+
+        if (valid) {
+            zmsg_t *reply = zmsg_new ();
+            zmsg_addstr (reply, uuid);
+            zmsg_addstr (reply, "OK");
+            zmsg_addstr (reply, type);
+            zlistx_t *metrics = rt_select_type (data, type, pattern);
+            if (topk)
+                s_dump_topk (metrics, (size_t) k, reply);
+            else
+                s_dump_range (metrics, minimum, maximum, reply);
+            zlistx_destroy (&metrics);
+            result = s_keep_reply (cache, key, &reply);
+        }
+        else {
+            log_warning (
+                    "Bad message. Expected multipart string message `uuid/TOPK/type/k[/element]`"
+                    " or `uuid/RANGE/type/min/max[/element]`. Sender: '%s', Subject: '%s'.",
+                    sender, RFC_RT_DATA_SUBJECT);
+        }
+        zstr_free (&pattern);
+        zstr_free (&second);
+        zstr_free (&first);
+        zstr_free (&type);
+    } else if (streq (command, "INFO")) {
+        char *element = zmsg_popstr (msg);
+        if (!element) {
+            zstr_free (&command);
+            zstr_free (&uuid);
+            zstr_free (&key);
+            zmsg_destroy (msg_p);
+            log_warning (
+                    "Bad message. Expected multipart string message `uuid/INFO/element`"
+                    " - 'element' is missing. Sender: '%s', Subject: '%s'.",
+                    sender, RFC_RT_DATA_SUBJECT);
+            return NULL;
+        }
+        zmsg_t *reply = zmsg_new ();
+        zmsg_addstr (reply, uuid);
+        zmsg_addstr (reply, "OK");
+        zmsg_addstr (reply, element);
+        rt_device_t *device = rt_get_device_info (data, element);
+        if (device) {
+            zmsg_addstrf (reply, "%zu", zhashx_size (device->metrics));
+            zmsg_addstrf (reply, "%" PRIu64, device->last_update);
+            zmsg_addstrf (reply, "%" PRIu64, device->earliest_expiry);
+            zmsg_addstrf (reply, "%.3f", device->update_rate);
+            zmsg_addstrf (reply, "%zu", device->bytes);
+        }
+        zstr_free (&element);
+
+        result = s_keep_reply (cache, key, &reply);
+    } else if (streq (command, "HISTORY")) {
+        char *element = zmsg_popstr (msg);
+        char *type = zmsg_popstr (msg);
+        // optional number of samples
+        char *count = zmsg_popstr (msg);
+        long n = -1;
+        if (count) {
+            char *end = NULL;
+            n = strtol (count, &end, 10);
+            if (end == count || *end != '\0' || n < 0)
+                n = -2;
+        }
+        if (element && type && n != -2) {
+            zmsg_t *reply = zmsg_new ();
+            zmsg_addstr (reply, uuid);
+            zmsg_addstr (reply, "OK");
+            zmsg_addstr (reply, element);
+            zmsg_addstr (reply, type);
+            zhashx_t *metrics = rt_get_element (data, element);
+            rt_metric_t *metric = metrics ? (rt_metric_t *) zhashx_lookup (metrics, type) : NULL;
+            if (metric && metric->history) {
+                size_t size = metric->history->size;
+                size_t first = (n >= 0 && (size_t) n < size) ? size - (size_t) n : 0;
+                for (size_t i = first; i < size; i++) {
+                    uint64_t time;
+                    double value;
+                    rt_history_sample (metric->history, i, &time, &value);
+                    zmsg_addstrf (reply, "%" PRIu64, time);
+                    zmsg_addstrf (reply, "%.15g", value);
+                }
+            }
+            result = s_keep_reply (cache, key, &reply);
+        }
+        else {
+            log_warning (
+                    "Bad message. Expected multipart string message `uuid/HISTORY/element/type[/n]`."
+                    " Sender: '%s', Subject: '%s'.",
+                    sender, RFC_RT_DATA_SUBJECT);
+        }
+        zstr_free (&count);
+        zstr_free (&type);
+        zstr_free (&element);
+    } else if (streq (command, "STATS")) {
+        zmsg_t *reply = zmsg_new ();
+        zmsg_addstr (reply, uuid);
+        zmsg_addstr (reply, "OK");
+        zmsg_addstrf (reply, "%zu", zhashx_size (data->devices));
+        zmsg_addstrf (reply, "%zu", zlistx_size (data->lru));
+        zmsg_addstrf (reply, "%zu", zhashx_size (data->types));
+        zmsg_addstrf (reply, "%zu", data->bytes);
+        zmsg_addstrf (reply, "%" PRIu64, data->evictions);
+        zmsg_addstrf (reply, "%.3f", rt_get_refresh_ratio (data));
+        zmsg_addstrf (reply, "%" PRIu64, data->rejected_element);
+        zmsg_addstrf (reply, "%" PRIu64, data->rejected_types);
+        // elements which hit the limit of measurements
+        rt_device_t *device = (rt_device_t *) zhashx_first (data->devices);
+        while (device) {
+            if (device->rejected) {
+                zmsg_addstr (reply, (const char *) zhashx_cursor (data->devices));
+                zmsg_addstrf (reply, "%" PRIu64, device->rejected);
+            }
+            device = (rt_device_t *) zhashx_next (data->devices);
+        }
+        result = s_keep_reply (cache, key, &reply);
+    } else if (streq (command, "ROLLUP")) {
+        char *element = zmsg_popstr (msg);
+        char *type = zmsg_popstr (msg);
+        if (element && type) {
+            zmsg_t *reply = zmsg_new ();
+            zmsg_addstr (reply, uuid);
+            zmsg_addstr (reply, "OK");
+            zmsg_addstr (reply, element);
+            zmsg_addstr (reply, type);
+            zhashx_t *metrics = rt_get_element (data, element);
+            rt_metric_t *metric = metrics ? (rt_metric_t *) zhashx_lookup (metrics, type) : NULL;
+            if (metric && metric->rollup) {
+                uint64_t now_s = (uint64_t) time (NULL);
+                const char *windows [] = { "1m", "15m" };
+                for (int window = RT_ROLLUP_1M; window <= RT_ROLLUP_15M; window++) {
+                    rt_bucket_t bucket;
+                    rt_rollup_get (metric->rollup, window, now_s, &bucket);
+                    zmsg_addstr (reply, windows [window]);
+                    zmsg_addstrf (reply, "%.15g", bucket.min);
+                    zmsg_addstrf (reply, "%.15g", bucket.max);
+                    zmsg_addstrf (reply, "%.15g", bucket.count ? bucket.sum / bucket.count : NAN);
+                    zmsg_addstrf (reply, "%" PRIu32, bucket.count);
+                }
+            }
+            result = s_keep_reply (cache, key, &reply);
+        }
+        else {
+            log_warning (
+                    "Bad message. Expected multipart string message `uuid/ROLLUP/element/type`."
+                    " Sender: '%s', Subject: '%s'.",
+                    sender, RFC_RT_DATA_SUBJECT);
+        }
+        zstr_free (&type);
+        zstr_free (&element);
     } else {
         log_warning (
                 "Unrecognized command %s. Sender: '%s', Subject: '%s'.",
-                command, mlm_client_sender (client), mlm_client_subject (client));
+                command, sender, RFC_RT_DATA_SUBJECT);
     }
+    zstr_free (&key);
     zstr_free (&uuid);
     zstr_free (&command);
     zmsg_destroy (msg_p);
-
+    return result;
 }
 //  --------------------------------------------------------------------------
 //  Self test of this class
@@ -250,6 +784,8 @@ mailbox_test (bool verbose)
 
     // data, fill
     rt_t *data = rt_new ();
+    rt_set_history (data, "temp", 10);
+    rt_set_rollup (data, "temp");
     fty_proto_t *metric = test_metric_new ("temp", "ups", "15", "C", 100);
     rt_put (data, &metric);
     metric = test_metric_new ("humidity", "ups", "40", "%", 200);
@@ -278,7 +814,7 @@ mailbox_test (bool verbose)
 
     zmsg_t *reply = mlm_client_recv (mailbox);
     assert (reply);
-    mailbox_perform (mailbox, &reply, data);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
     reply = mlm_client_recv (ui);
     assert (reply);
     assert (streq (mlm_client_subject (ui), RFC_RT_DATA_SUBJECT));
@@ -337,7 +873,7 @@ mailbox_test (bool verbose)
 
     reply = mlm_client_recv (mailbox);
     assert (reply);
-    mailbox_perform (mailbox, &reply, data);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
 
     log_debug ("Waiting in zpoller for 5000ms");
     zpoller_t *poller = zpoller_new (mlm_client_msgpipe (ui), NULL);
@@ -364,7 +900,7 @@ mailbox_test (bool verbose)
 
     reply = mlm_client_recv (mailbox);
     assert (reply);
-    mailbox_perform (mailbox, &reply, data);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
     reply = mlm_client_recv (ui);
     assert (reply);
     assert (streq (mlm_client_subject (ui), RFC_RT_DATA_SUBJECT));
@@ -390,6 +926,736 @@ mailbox_test (bool verbose)
 
     // End Test case #3
 
+    // ===============================================
+    // Test case #4:
+    //      GET u.s (regex, no element of that name)
+    // Expected:
+    //      3 measurements of ups
+    // ===============================================
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "GET");
+    zmsg_addstr (send, "u.s");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 3 + 3);
+    zmsg_destroy (&reply);
+
+    // End Test case #4
+
+    // ===============================================
+    // Test case #4a:
+    //      GET ups.1 (literal name with regex metacharacter)
+    //      GET ups-2 (literal name not in the cache)
+    // Expected:
+    //      only the measurement of ups.1, not of upsx1
+    //      0 measurements
+    // ===============================================
+    {
+        rt_t *literal = rt_new ();
+        metric = test_metric_new ("realpower.default", "ups.1", "100", "W", 100);
+        rt_put (literal, &metric);
+        metric = test_metric_new ("realpower.default", "upsx1", "200", "W", 100);
+        rt_put (literal, &metric);
+        metric = test_metric_new ("realpower.default", "ups-1", "300", "W", 100);
+        rt_put (literal, &metric);
+
+        send = zmsg_new ();
+        zmsg_addstr (send, "12345");
+        zmsg_addstr (send, "GET");
+        zmsg_addstr (send, "ups.1");
+        reply = mailbox_reply ("UI", &send, literal, NULL);
+        assert (reply);
+        assert (zmsg_size (reply) == 3 + 1);
+        uuid = zmsg_popstr (reply);
+        zstr_free (&uuid);
+        command = zmsg_popstr (reply);
+        assert (streq (command, "OK"));
+        zstr_free (&command);
+        element = zmsg_popstr (reply);
+        assert (streq (element, "ups.1"));
+        zstr_free (&element);
+        encoded = zmsg_popmsg (reply);
+        proto = fty_proto_decode (&encoded);
+        test_assert_proto (proto, "realpower.default", "ups.1", "100", "W", 100);
+        fty_proto_destroy (&proto);
+        zmsg_destroy (&reply);
+
+        send = zmsg_new ();
+        zmsg_addstr (send, "12345");
+        zmsg_addstr (send, "GET");
+        zmsg_addstr (send, "ups-2");
+        reply = mailbox_reply ("UI", &send, literal, NULL);
+        assert (reply);
+        assert (zmsg_size (reply) == 3);
+        zmsg_destroy (&reply);
+        rt_destroy (&literal);
+    }
+
+    // End Test case #4a
+
+    // ===============================================
+    // Test case #5:
+    //      GETTYPE humidity
+    //      GETTYPE humidity ep.*
+    //      GETTYPE humidity switch
+    // Expected:
+    //      2 measurements
+    //      1 measurement
+    //      0 measurements
+    // ===============================================
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "GETTYPE");
+    zmsg_addstr (send, "humidity");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 3 + 2);
+    zmsg_destroy (&reply);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "GETTYPE");
+    zmsg_addstr (send, "humidity");
+    zmsg_addstr (send, "ep.*");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+
+    uuid = zmsg_popstr (reply);
+    assert (streq (uuid, "12345"));
+    zstr_free (&uuid);
+    command = zmsg_popstr (reply);
+    assert (streq (command, "OK"));
+    zstr_free (&command);
+    element = zmsg_popstr (reply);
+    assert (streq (element, "humidity"));
+    zstr_free (&element);
+
+    encoded = zmsg_popmsg (reply);
+    assert (encoded);
+    proto = fty_proto_decode (&encoded);
+    test_assert_proto (proto, "humidity", "epdu", "21", "%", 100);
+    fty_proto_destroy (&proto);
+    encoded = zmsg_popmsg (reply);
+    assert (encoded == NULL);
+    zmsg_destroy (&reply);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "GETTYPE");
+    zmsg_addstr (send, "humidity");
+    zmsg_addstr (send, "switch");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 3);
+    zmsg_destroy (&reply);
+
+    // End Test case #5
+
+    // ===============================================
+    // Test case #6:
+    //      AGG sum .* humidity
+    //      AGG max ups .*
+    //      AGG median ups .*
+    // Expected:
+    //      61, 2 samples
+    //      40, 3 samples
+    //      no reply
+    // ===============================================
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "AGG");
+    zmsg_addstr (send, "sum");
+    zmsg_addstr (send, ".*");
+    zmsg_addstr (send, "humidity");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 6);
+
+    uuid = zmsg_popstr (reply);
+    assert (streq (uuid, "12345"));
+    zstr_free (&uuid);
+    command = zmsg_popstr (reply);
+    assert (streq (command, "OK"));
+    zstr_free (&command);
+    char *operation = zmsg_popstr (reply);
+    assert (streq (operation, "sum"));
+    zstr_free (&operation);
+    char *value = zmsg_popstr (reply);
+    assert (streq (value, "61"));
+    zstr_free (&value);
+    char *count = zmsg_popstr (reply);
+    assert (streq (count, "2"));
+    zstr_free (&count);
+    zmsg_destroy (&reply);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "AGG");
+    zmsg_addstr (send, "max");
+    zmsg_addstr (send, "ups");
+    zmsg_addstr (send, ".*");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    uuid = zmsg_popstr (reply);
+    zstr_free (&uuid);
+    command = zmsg_popstr (reply);
+    zstr_free (&command);
+    operation = zmsg_popstr (reply);
+    assert (streq (operation, "max"));
+    zstr_free (&operation);
+    value = zmsg_popstr (reply);
+    assert (streq (value, "40"));
+    zstr_free (&value);
+    count = zmsg_popstr (reply);
+    assert (streq (count, "3"));
+    zstr_free (&count);
+    zmsg_destroy (&reply);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "AGG");
+    zmsg_addstr (send, "median");
+    zmsg_addstr (send, "ups");
+    zmsg_addstr (send, ".*");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+
+    poller = zpoller_new (mlm_client_msgpipe (ui), NULL);
+    which = zpoller_wait (poller, 1000);
+    assert (which == NULL);
+    zpoller_destroy (&poller);
+
+    // End Test case #6
+
+    // ===============================================
+    // Test case #7:
+    //      TOPK humidity 1
+    //      RANGE humidity 0 30
+    // Expected:
+    //      humidity@ups
+    //      humidity@epdu
+    // ===============================================
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "TOPK");
+    zmsg_addstr (send, "humidity");
+    zmsg_addstr (send, "1");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 3 + 1);
+    uuid = zmsg_popstr (reply);
+    zstr_free (&uuid);
+    command = zmsg_popstr (reply);
+    zstr_free (&command);
+    element = zmsg_popstr (reply);
+    zstr_free (&element);
+    encoded = zmsg_popmsg (reply);
+    proto = fty_proto_decode (&encoded);
+    test_assert_proto (proto, "humidity", "ups", "40", "%", 200);
+    fty_proto_destroy (&proto);
+    zmsg_destroy (&reply);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "RANGE");
+    zmsg_addstr (send, "humidity");
+    zmsg_addstr (send, "0");
+    zmsg_addstr (send, "30");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 3 + 1);
+    uuid = zmsg_popstr (reply);
+    zstr_free (&uuid);
+    command = zmsg_popstr (reply);
+    zstr_free (&command);
+    element = zmsg_popstr (reply);
+    zstr_free (&element);
+    encoded = zmsg_popmsg (reply);
+    proto = fty_proto_decode (&encoded);
+    test_assert_proto (proto, "humidity", "epdu", "21", "%", 100);
+    fty_proto_destroy (&proto);
+    zmsg_destroy (&reply);
+
+    // End Test case #7
+
+    // ===============================================
+    // Test case #8:
+    //      INFO ups
+    //      INFO non-existant-element
+    // Expected:
+    //      summary of 3 measurements
+    //      no summary
+    // ===============================================
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "INFO");
+    zmsg_addstr (send, "ups");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 3 + 5);
+    uuid = zmsg_popstr (reply);
+    zstr_free (&uuid);
+    command = zmsg_popstr (reply);
+    assert (streq (command, "OK"));
+    zstr_free (&command);
+    element = zmsg_popstr (reply);
+    assert (streq (element, "ups"));
+    zstr_free (&element);
+    count = zmsg_popstr (reply);
+    assert (streq (count, "3"));
+    zstr_free (&count);
+    zmsg_destroy (&reply);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "INFO");
+    zmsg_addstr (send, "non-existant-element");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 3);
+    zmsg_destroy (&reply);
+
+    // End Test case #8
+
+    // ===============================================
+    // Test case #9:
+    //      HISTORY ups temp 1 (after another sample)
+    //      HISTORY ups humidity
+    // Expected:
+    //      the latest sample
+    //      no samples
+    // ===============================================
+    metric = test_metric_new ("temp", "ups", "16", "C", 100);
+    rt_put (data, &metric);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "HISTORY");
+    zmsg_addstr (send, "ups");
+    zmsg_addstr (send, "temp");
+    zmsg_addstr (send, "1");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 4 + 2);
+    for (int i = 0; i < 5; i++) {
+        value = zmsg_popstr (reply);
+        zstr_free (&value);
+    }
+    value = zmsg_popstr (reply);
+    assert (streq (value, "16"));
+    zstr_free (&value);
+    zmsg_destroy (&reply);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "HISTORY");
+    zmsg_addstr (send, "ups");
+    zmsg_addstr (send, "humidity");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 4);
+    zmsg_destroy (&reply);
+
+    // End Test case #9
+
+    // ===============================================
+    // Test case #10:
+    //      ROLLUP ups temp
+    // Expected:
+    //      1m and 15m of 15, 16
+    // ===============================================
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "ROLLUP");
+    zmsg_addstr (send, "ups");
+    zmsg_addstr (send, "temp");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 4 + 2 * 5);
+    for (int i = 0; i < 4; i++) {
+        value = zmsg_popstr (reply);
+        zstr_free (&value);
+    }
+    for (int i = 0; i < 2; i++) {
+        char *window = zmsg_popstr (reply);
+        assert (streq (window, i == 0 ? "1m" : "15m"));
+        zstr_free (&window);
+        value = zmsg_popstr (reply);
+        assert (streq (value, "15"));
+        zstr_free (&value);
+        value = zmsg_popstr (reply);
+        assert (streq (value, "16"));
+        zstr_free (&value);
+        value = zmsg_popstr (reply);
+        assert (streq (value, "15.5"));
+        zstr_free (&value);
+        count = zmsg_popstr (reply);
+        assert (streq (count, "2"));
+        zstr_free (&count);
+    }
+    zmsg_destroy (&reply);
+
+    // End Test case #10
+
+    // ===============================================
+    // Test case #11:
+    //      STATS (after a measurement over the limit of ups)
+    // Expected:
+    //      3 devices, 6 measurements of 5 types, ups as the offender
+    // ===============================================
+    rt_set_cardinality_limits (data, 3, 0);
+    metric = test_metric_new ("voltage", "ups", "230", "V", 100);
+    rt_put (data, &metric);
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "STATS");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 2 + 8 + 2);
+    {
+        const char *expected [] = { "12345", "OK", "3", "6", "5" };
+        for (int i = 0; i < 5; i++) {
+            value = zmsg_popstr (reply);
+            assert (streq (value, expected [i]));
+            zstr_free (&value);
+        }
+        for (int i = 0; i < 4; i++) {
+            value = zmsg_popstr (reply);
+            zstr_free (&value);
+        }
+        value = zmsg_popstr (reply);
+        assert (streq (value, "1"));
+        zstr_free (&value);
+        value = zmsg_popstr (reply);
+        assert (streq (value, "0"));
+        zstr_free (&value);
+    }
+    element = zmsg_popstr (reply);
+    assert (streq (element, "ups"));
+    zstr_free (&element);
+    count = zmsg_popstr (reply);
+    assert (streq (count, "1"));
+    zstr_free (&count);
+    zmsg_destroy (&reply);
+
+    // End Test case #11
+
+    // ===============================================
+    // Test case #12:
+    //      GET rack-1 (after ups and epdu were placed in it)
+    // Expected:
+    //      1 total of realpower.default
+    // ===============================================
+    rt_set_cardinality_limits (data, 0, 0);
+    rt_set_topology (data, "realpower\\..*");
+    {
+        zlistx_t *ancestors = zlistx_new ();
+        zlistx_add_end (ancestors, (void *) "rack-1");
+        zlistx_add_end (ancestors, (void *) "room-1");
+        rt_set_parents (data, "ups", ancestors);
+        metric = test_metric_new ("realpower.default", "ups", "42", "W", 200);
+        rt_put (data, &metric);
+        metric = test_metric_new ("realpower.default", "epdu", "8", "W", 200);
+        rt_put (data, &metric);
+        rt_set_parents (data, "epdu", ancestors);
+        zlistx_destroy (&ancestors);
+    }
+
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "GET");
+    zmsg_addstr (send, "rack-1");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    assert (zmsg_size (reply) == 3 + 1);
+    for (int i = 0; i < 3; i++) {
+        value = zmsg_popstr (reply);
+        zstr_free (&value);
+    }
+    {
+        encoded = zmsg_popmsg (reply);
+        fty_proto_t *total = fty_proto_decode (&encoded);
+        assert (total);
+        assert (streq (fty_proto_type (total), "realpower.default.sum"));
+        assert (streq (fty_proto_name (total), "rack-1"));
+        assert (streq (fty_proto_unit (total), "W"));
+        assert (streq (fty_proto_value (total), "50"));
+        assert (streq (fty_proto_aux_string (total, "count", ""), "2"));
+        fty_proto_destroy (&total);
+    }
+    zmsg_destroy (&reply);
+
+    // End Test case #12
+
+    // Test case #13:
+    //      GET ups twice with a reply cache, then after ups changed
+    // Expected:
+    //      the same reply to both requests but uuid, a new one after change
+    // ===============================================
+    {
+        reply_cache_t *cache = reply_cache_new (10, 60000);
+        zmsg_t *replies [3];
+        for (int i = 0; i < 3; i++) {
+            if (i == 2) {
+                metric = test_metric_new ("realpower.default", "ups", "43", "W", 200);
+                rt_put (data, &metric);
+            }
+            send = zmsg_new ();
+            zmsg_addstrf (send, "uuid-%d", i);
+            zmsg_addstr (send, "GET");
+            zmsg_addstr (send, "ups");
+            rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+            assert (rv == 0);
+
+            reply = mlm_client_recv (mailbox);
+            assert (reply);
+            mailbox_perform (mailbox, &reply, data, NULL, cache);
+            replies [i] = mlm_client_recv (ui);
+            assert (replies [i]);
+            value = zmsg_popstr (replies [i]);
+            char *expected = zsys_sprintf ("uuid-%d", i);
+            assert (streq (value, expected));
+            zstr_free (&expected);
+            zstr_free (&value);
+        }
+        char *first = reply_cache_key (replies [0]);
+        char *second = reply_cache_key (replies [1]);
+        char *third = reply_cache_key (replies [2]);
+        assert (streq (first, second));
+        assert (!streq (first, third));
+        zstr_free (&third);
+        zstr_free (&second);
+        zstr_free (&first);
+        for (int i = 0; i < 3; i++)
+            zmsg_destroy (&replies [i]);
+        reply_cache_destroy (&cache);
+    }
+    // End Test case #13
+
+    // Test case #13a:
+    //      GETTYPE humidity twice with a reply cache, the metric refreshed
+    //      in between
+    // Expected:
+    //      the second reply has the new time
+    // ===============================================
+    {
+        rt_t *refreshed = rt_new ();
+        reply_cache_t *cache = reply_cache_new (10, 60000);
+        uint64_t now_s = (uint64_t) time (NULL);
+        for (int i = 0; i < 2; i++) {
+            metric = test_metric_new ("humidity", "epdu", "21", "%", 100);
+            fty_proto_set_time (metric, now_s - 10 + i);
+            rt_put (refreshed, &metric);
+
+            send = zmsg_new ();
+            zmsg_addstr (send, "12345");
+            zmsg_addstr (send, "GETTYPE");
+            zmsg_addstr (send, "humidity");
+            reply = mailbox_reply ("UI", &send, refreshed, cache);
+            assert (reply);
+            assert (zmsg_size (reply) == 3 + 1);
+            for (int frame = 0; frame < 3; frame++) {
+                value = zmsg_popstr (reply);
+                zstr_free (&value);
+            }
+            encoded = zmsg_popmsg (reply);
+            proto = fty_proto_decode (&encoded);
+            assert (proto);
+            assert (fty_proto_time (proto) == now_s - 10 + i);
+            fty_proto_destroy (&proto);
+            zmsg_destroy (&reply);
+        }
+        reply_cache_destroy (&cache);
+        rt_destroy (&refreshed);
+    }
+    // End Test case #13a
+
+    // Test case #13b:
+    //      GET sensor-.* with a reply cache while the only metric of
+    //      sensor-1 expired but was not purged, then after it was updated
+    // Expected:
+    //      0 measurements, then 1, which stays in the cache
+    // ===============================================
+    {
+        rt_t *expired = rt_new ();
+        reply_cache_t *cache = reply_cache_new (10, 60000);
+        uint64_t now_s = (uint64_t) time (NULL);
+        metric = test_metric_new ("temperature", "sensor-1", "20", "C", 100);
+        fty_proto_set_time (metric, now_s - 200);
+        rt_put (expired, &metric);
+        for (int i = 0; i < 2; i++) {
+            if (i == 1) {
+                metric = test_metric_new ("temperature", "sensor-1", "21", "C", 100);
+                rt_put (expired, &metric);
+            }
+            send = zmsg_new ();
+            zmsg_addstr (send, "12345");
+            zmsg_addstr (send, "GET");
+            zmsg_addstr (send, "sensor-.*");
+            reply = mailbox_reply ("UI", &send, expired, cache);
+            assert (reply);
+            assert (zmsg_size (reply) == (size_t) (3 + i));
+            zmsg_destroy (&reply);
+        }
+        // the metric expired before does not make the reply stale
+        send = zmsg_new ();
+        zmsg_addstr (send, "GET");
+        zmsg_addstr (send, "sensor-.*");
+        char *key = reply_cache_key (send);
+        zmsg_destroy (&send);
+        reply = reply_cache_lookup (cache, key, expired);
+        assert (reply);
+        assert (zmsg_size (reply) == 3);
+        zmsg_destroy (&reply);
+        zstr_free (&key);
+        reply_cache_destroy (&cache);
+        rt_destroy (&expired);
+    }
+    // End Test case #13b
+
+    // Test case #14:
+    //      MGET ups and nothing-like-that
+    // Expected:
+    //      metrics of ups, none of the other
+    // ===============================================
+    send = zmsg_new ();
+    zmsg_addstr (send, "12345");
+    zmsg_addstr (send, "MGET");
+    zmsg_addstr (send, "ups");
+    zmsg_addstr (send, "nothing-like-that");
+    rv = mlm_client_sendto (ui, "MAILBOX", RFC_RT_DATA_SUBJECT, NULL, 5000, &send);
+    assert (rv == 0);
+
+    reply = mlm_client_recv (mailbox);
+    assert (reply);
+    mailbox_perform (mailbox, &reply, data, NULL, NULL);
+    reply = mlm_client_recv (ui);
+    assert (reply);
+    {
+        const char *expected [] = { "12345", "OK", "MGET", "ups" };
+        for (int i = 0; i < 4; i++) {
+            value = zmsg_popstr (reply);
+            assert (streq (value, expected [i]));
+            zstr_free (&value);
+        }
+        value = zmsg_popstr (reply);
+        long n = atol (value);
+        zstr_free (&value);
+        assert (n > 0);
+        for (long i = 0; i < n; i++) {
+            encoded = zmsg_popmsg (reply);
+            proto = fty_proto_decode (&encoded);
+            assert (proto);
+            assert (streq (fty_proto_name (proto), "ups"));
+            fty_proto_destroy (&proto);
+        }
+        value = zmsg_popstr (reply);
+        assert (streq (value, "nothing-like-that"));
+        zstr_free (&value);
+        value = zmsg_popstr (reply);
+        assert (streq (value, "0"));
+        zstr_free (&value);
+        assert (zmsg_size (reply) == 0);
+    }
+    zmsg_destroy (&reply);
+    // End Test case #14
+
     rt_destroy (&data);
     mlm_client_destroy (&ui);
     mlm_client_destroy (&mailbox);
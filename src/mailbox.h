@@ -37,17 +37,47 @@ extern "C" {
 
     1) uuid/LIST        - Request list of elements
     2) uuid/GET/element - Request latest real time measurements of element
+    3) uuid/GETTYPE/type[/element] - Request latest real time measurements of
+                        given type of all elements (matching 'element')
+    7) uuid/AGG/operation/element/type - Request aggregate of numeric values
+                        of current measurements matching 'element' and 'type'
+    9) uuid/TOPK/type/k[/element] - Request 'k' current measurements of given
+                        type with the highest numeric values
+   10) uuid/RANGE/type/min/max[/element] - Request current measurements of
+                        given type with numeric value between 'min' and 'max'
+   11) uuid/INFO/element - Request summary of measurements of element
+   13) uuid/HISTORY/element/type[/n] - Request the last 'n' (default all) samples
+                        of history of measurement
+   15) uuid/ROLLUP/element/type - Request rolling aggregates of measurement
+   17) uuid/STATS        - Request statistics of the cache
+   19) uuid/MGET/element^i - Request latest real time measurements of several
+                        elements at once
 
     where
         * '/' indicates a multipart _string_ message
         * 'uuid' is unique universal identifier
-        * 'element' is name of asset element
+        * 'element' is name of asset element or a regex matching names of asset
+          elements; it is treated as a regex only when it contains one of the
+          characters .[]()*+?{}|^$\ and as a literal name otherwise
+        * 'type' is name of a measurement, e.g. realpower.default; for AGG it
+          may be a regex like 'element'
+        * 'operation' is one of sum, avg, min, max, count
+        * 'min' and 'max' are inclusive bounds, empty string means unbounded
         * subject of the message MUST be "latest-rt-data"
 
  The RT-PROVIDER peer MUST respond with one of the following messages:
 
-    3) uuid/OK/LIST/element_name^i
-    4) uuid/OK/element/data^i
+    4) uuid/OK/LIST/element_name^i  (for 1)
+    5) uuid/OK/element/data^i       (for 2)
+    6) uuid/OK/type/data^i          (for 3, 9 and 10, for 9 ordered by value
+                                     from the highest)
+    8) uuid/OK/operation/value/count/oldest (for 7)
+   12) uuid/OK/element[/metrics/last_update/earliest_expiry/update_rate/bytes] (for 11)
+   14) uuid/OK/element/type/time^i/value^i (for 13)
+   16) uuid/OK/element/type[/1m/min/max/avg/count/15m/min/max/avg/count] (for 15)
+   18) uuid/OK/devices/metrics/types/bytes/evictions/refresh_ratio/
+           rejected_element/rejected_types/offender^i/rejected^i (for 17)
+   20) uuid/OK/MGET/(element/n/data^n)^i (for 19)
 
     where
         * '/' indicates a multipart _frame_ message
@@ -56,10 +86,40 @@ extern "C" {
         * 'data^i' is anywhere between 0 to N frames, each with encoded bios_proto_t METRIC
             (i.e. one of latest real time measurements of requested element).
             Zero frames mean given element  has no latest measurements or does not exist.
+            For a literal element, they are followed by its totals '<type>.sum'
+            of measurements of its descendants (see rt_set_topology).
+        * 'value' is the aggregate ("nan" for avg/min/max without samples),
+          'count' is number of numeric samples aggregated and 'oldest' is
+          the time (seconds since epoch) of the oldest of them, 0 without samples
+        * 'metrics' is number of measurements of element, 'last_update' the latest
+          time of them, 'earliest_expiry' the time the first one expires,
+          'update_rate' the number of updates per second measured between the
+          last two purges and 'bytes' the approximate memory they use; these
+          frames are missing when element has no measurements or does not exist
+        * 'time^i/value^i' are pairs of frames with time and numeric value of
+          samples, oldest first; zero pairs mean history is not kept for the
+          type (see rt_set_history) or measurement does not exist
+        * '1m' and '15m' are followed by aggregates of numeric samples of the
+          last 1 minute (10 seconds granularity) and 15 minutes (1 minute
+          granularity); they are missing when rollups are not kept for the type
+          (see rt_set_rollup) or measurement does not exist
+        * 'devices', 'metrics' and 'types' are numbers of cached elements,
+          measurements and distinct types, 'bytes' their approximate memory,
+          'evictions' number of measurements evicted over the memory limit,
+          'refresh_ratio' ratio of updates only refreshing time and ttl,
+          'rejected_element' and 'rejected_types' numbers of new measurements
+          rejected over the limit per element and of distinct types
+        * 'offender^i/rejected^i' are pairs of frames with name of element
+          which hit the limit of measurements and the number rejected
+        * 'element/n/data^n' are repeated for each requested element, with
+          'n' the number of 'data' frames following, as in 5)
         * 'element_name^i' is anywhere between 0 to N strings, each representing one element.
             Zero strings mean there are no elements being stored yet.
         * subject of the message MUST be repeated from request message 1)
 
+ The same requests are accepted on the ROUTER endpoint of the server (see
+ fty_metric_cache_server.h), without subject; replies come back in order.
+
  In case the UI peer sends a message to RT-PROVIDER not conforming to 1), i.e. the message
  has bad format or the subject is incorrect, RT-PROVIDER peer SHALL NOT respond back.
 
@@ -67,9 +127,18 @@ extern "C" {
 
 #define RFC_RT_DATA_SUBJECT "latest-rt-data"
 
-//  Perform mailbox deliver protocol
+//  Perform mailbox deliver protocol, queueing the reply to 'outbox' or
+//  sending it right away when it is NULL. Replies are shared by identical
+//  requests through 'cache' unless it is NULL.
 FTY_METRIC_CACHE_EXPORT void
-    mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data);
+    mailbox_perform (mlm_client_t *client, zmsg_t **msg_p, rt_t *data, outbox_t *outbox, reply_cache_t *cache);
+
+//  Compute reply to request of 'sender' (used in logs) following the protocol
+//  above, NULL when the request is malformed. Replies are shared by
+//  identical requests through 'cache' unless it is NULL.
+//  Caller owns the returned message
+FTY_METRIC_CACHE_EXPORT zmsg_t *
+    mailbox_reply (const char *sender, zmsg_t **msg_p, rt_t *data, reply_cache_t *cache);
 
 //  Note: Keep this definition in sync with fty_metric_cache_classes.h
 FTY_METRIC_CACHE_PRIVATE void
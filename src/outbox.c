@@ -0,0 +1,321 @@
+/*  =========================================================================
+    outbox - replies queued per client
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    outbox - replies queued per client
+@discuss
+    All replies go through one malamute connection, and the broker queues
+    mailbox messages per recipient on its side. The agent cannot tell that
+    one recipient is slow. What it can see is the pipe to its own malamute
+    client actor filling up when the broker does not keep up. mlm_client_sendto
+    would then block the actor.
+
+    So replies are queued here per recipient and sent only while that pipe
+    accepts them without blocking. While it is full, the actor goes on
+    receiving and storing metrics. The queues are drained one reply per
+    recipient in turn, so a recipient with many replies waiting does not
+    delay the others. Each queue is bounded; when one is full, its oldest
+    reply is dropped, because that client most likely gave up waiting.
+@end
+*/
+
+#include "fty_metric_cache_classes.h"
+
+//  Reply waiting to be sent
+
+typedef struct {
+    char *subject;
+    zmsg_t *message;
+    int64_t queued;         // zclock_usecs () when it was queued
+} s_reply_t;
+
+static void
+s_reply_destroy (s_reply_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    s_reply_t *self = *self_p;
+    zstr_free (&self->subject);
+    zmsg_destroy (&self->message);
+    free (self);
+    *self_p = NULL;
+}
+
+//  Structure of our class
+
+struct _outbox_t {
+    zhashx_t *queues;       // hash ("address", zlistx_t* of s_reply_t*)
+    size_t limit;           // replies queued per client at most
+    size_t size;            // replies queued
+    uint64_t sent;          // replies sent since the last report
+    uint64_t dropped;       // replies dropped since the last report
+    int64_t latency_sum;    // microseconds the sent replies waited
+    int64_t latency_max;    // the longest of them
+};
+
+//  --------------------------------------------------------------------------
+//  Create a new outbox
+
+outbox_t *
+outbox_new (size_t limit)
+{
+    outbox_t *self = (outbox_t *) zmalloc (sizeof (outbox_t));
+    assert (self);
+    self->queues = zhashx_new ();
+    zhashx_set_destructor (self->queues, (zhashx_destructor_fn *) zlistx_destroy);
+    self->limit = limit > 0 ? limit : 1;
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the outbox
+
+void
+outbox_destroy (outbox_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    outbox_t *self = *self_p;
+    zhashx_destroy (&self->queues);
+    free (self);
+    *self_p = NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Queue reply for mailbox 'address'
+
+int
+outbox_send (outbox_t *self, const char *address, const char *subject, zmsg_t **message_p)
+{
+    assert (self);
+    assert (address);
+    assert (subject);
+    assert (message_p && *message_p);
+
+    zlistx_t *queue = (zlistx_t *) zhashx_lookup (self->queues, address);
+    if (!queue) {
+        queue = zlistx_new ();
+        zlistx_set_destructor (queue, (czmq_destructor *) s_reply_destroy);
+        zhashx_insert (self->queues, address, queue);
+    }
+
+    int rv = 0;
+    if (zlistx_size (queue) >= self->limit) {
+        // the client most likely gave up waiting for the oldest one
+        s_reply_t *oldest = (s_reply_t *) zlistx_detach (queue, NULL);
+        s_reply_destroy (&oldest);
+        self->size--;
+        self->dropped++;
+        rv = 1;
+    }
+
+    s_reply_t *reply = (s_reply_t *) zmalloc (sizeof (s_reply_t));
+    assert (reply);
+    reply->subject = strdup (subject);
+    reply->message = *message_p;
+    *message_p = NULL;
+    reply->queued = zclock_usecs ();
+    zlistx_add_end (queue, reply);
+    self->size++;
+    return rv;
+}
+
+//  Send queued replies through 'client' as long as 'writable' accepts a
+//  message without blocking
+
+static size_t
+s_flush (outbox_t *self, void *writable, mlm_client_t *client)
+{
+    bool progress = true;
+    while (self->size > 0 && progress) {
+        progress = false;
+        zlistx_t *queue = (zlistx_t *) zhashx_first (self->queues);
+        while (queue) {
+            if (!(zsock_events (writable) & ZMQ_POLLOUT))
+                return self->size;
+
+            s_reply_t *reply = (s_reply_t *) zlistx_detach (queue, NULL);
+            if (reply) {
+                const char *address = (const char *) zhashx_cursor (self->queues);
+                int rv = mlm_client_sendto (client, address, reply->subject, NULL, 5000, &reply->message);
+                if (rv != 0) {
+                    log_error (
+                            "mlm_client_sendto (address = '%s', subject = '%s', timeout = '5000') failed.",
+                            address, reply->subject);
+                }
+                int64_t latency = zclock_usecs () - reply->queued;
+                self->latency_sum += latency;
+                if (latency > self->latency_max)
+                    self->latency_max = latency;
+                self->sent++;
+                self->size--;
+                s_reply_destroy (&reply);
+                progress = true;
+            }
+            queue = (zlistx_t *) zhashx_next (self->queues);
+        }
+    }
+    // forget clients which got everything
+    if (self->size == 0)
+        zhashx_purge (self->queues);
+    return self->size;
+}
+
+//  --------------------------------------------------------------------------
+//  Send queued replies as long as the client accepts them without blocking
+
+size_t
+outbox_flush (outbox_t *self, mlm_client_t *client)
+{
+    assert (self);
+    assert (client);
+
+    // the pipe to the client actor, which passes messages on to the broker
+    return s_flush (self, mlm_client_actor (client), client);
+}
+
+//  --------------------------------------------------------------------------
+//  Get number of queued replies
+
+size_t
+outbox_size (outbox_t *self)
+{
+    assert (self);
+    return self->size;
+}
+
+//  --------------------------------------------------------------------------
+//  Log statistics of replies since the previous report
+
+void
+outbox_report (outbox_t *self)
+{
+    assert (self);
+
+    int64_t average = self->sent ? self->latency_sum / (int64_t) self->sent : 0;
+    if (self->dropped > 0)
+        log_warning ("Replies sent %" PRIu64 ", dropped %" PRIu64 " over the limit, %zu queued, "
+                "latency average %" PRIi64 " us, max %" PRIi64 " us",
+                self->sent, self->dropped, self->size, average, self->latency_max);
+    else
+        log_debug ("Replies sent %" PRIu64 ", %zu queued, latency average %" PRIi64 " us, max %" PRIi64 " us",
+                self->sent, self->size, average, self->latency_max);
+    self->sent = 0;
+    self->dropped = 0;
+    self->latency_sum = 0;
+    self->latency_max = 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+outbox_test (bool verbose)
+{
+    static const char* endpoint = "inproc://fty-metric-cache-outbox-test";
+
+    ftylog_setInstance ("outbox", "");
+
+    if (verbose)
+        ftylog_setVeboseMode (ftylog_getInstance ());
+
+    //  @selftest
+    zactor_t *server = zactor_new (mlm_server, (void *) "Malamute");
+    zstr_sendx (server, "BIND", endpoint, NULL);
+    if (verbose)
+        zstr_send (server, "VERBOSE");
+
+    mlm_client_t *ui = mlm_client_new ();
+    mlm_client_connect (ui, endpoint, 1000, "UI");
+
+    mlm_client_t *agent = mlm_client_new ();
+    mlm_client_connect (agent, endpoint, 1000, "AGENT");
+
+    outbox_t *outbox = outbox_new (2);
+    assert (outbox);
+    for (int i = 1; i <= 3; i++) {
+        zmsg_t *message = zmsg_new ();
+        zmsg_addstrf (message, "%d", i);
+        int rv = outbox_send (outbox, "UI", "subject", &message);
+        assert (message == NULL);
+        // the third reply pushes the first one out
+        assert (rv == (i == 3 ? 1 : 0));
+    }
+    assert (outbox_size (outbox) == 2);
+
+    size_t left = outbox_flush (outbox, agent);
+    assert (left == 0);
+    assert (outbox_size (outbox) == 0);
+
+    for (int i = 2; i <= 3; i++) {
+        zmsg_t *message = mlm_client_recv (ui);
+        assert (message);
+        assert (streq (mlm_client_sender (ui), "AGENT"));
+        assert (streq (mlm_client_subject (ui), "subject"));
+        char *value = zmsg_popstr (message);
+        assert (atoi (value) == i);
+        zstr_free (&value);
+        zmsg_destroy (&message);
+    }
+    outbox_report (outbox);
+
+    // nothing is sent while the way out is blocked, a PUSH socket without
+    // peers never accepts a message
+    zsock_t *blocked = zsock_new (ZMQ_PUSH);
+    assert (blocked);
+    for (int i = 1; i <= 3; i++) {
+        zmsg_t *message = zmsg_new ();
+        zmsg_addstrf (message, "%d", i);
+        outbox_send (outbox, "UI", "subject", &message);
+    }
+    left = s_flush (outbox, blocked, agent);
+    assert (left == 2);
+    zsock_destroy (&blocked);
+    zpoller_t *poller = zpoller_new (mlm_client_msgpipe (ui), NULL);
+    assert (zpoller_wait (poller, 100) == NULL);
+    zpoller_destroy (&poller);
+
+    // once unblocked, the two newest replies come
+    left = outbox_flush (outbox, agent);
+    assert (left == 0);
+    for (int i = 2; i <= 3; i++) {
+        zmsg_t *message = mlm_client_recv (ui);
+        assert (message);
+        char *value = zmsg_popstr (message);
+        assert (atoi (value) == i);
+        zstr_free (&value);
+        zmsg_destroy (&message);
+    }
+
+    // queued replies are destroyed with the outbox
+    zmsg_t *message = zmsg_new ();
+    zmsg_addstr (message, "never sent");
+    outbox_send (outbox, "UI", "subject", &message);
+    outbox_destroy (&outbox);
+    outbox_destroy (&outbox);
+
+    mlm_client_destroy (&agent);
+    mlm_client_destroy (&ui);
+    zactor_destroy (&server);
+    //  @end
+    log_info ("OK\n");
+}
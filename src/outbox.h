@@ -0,0 +1,71 @@
+/*  =========================================================================
+    outbox - replies queued per client
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef OUTBOX_H_INCLUDED
+#define OUTBOX_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+
+//  Create a new outbox keeping at most 'limit' replies per client
+FTY_METRIC_CACHE_EXPORT outbox_t *
+    outbox_new (size_t limit);
+
+//  Queue reply for mailbox 'address' transfering ownership. When the client
+//  has 'limit' replies queued already, its oldest one is dropped.
+//  0 - queued, 1 - queued, an older reply was dropped
+FTY_METRIC_CACHE_EXPORT int
+    outbox_send (outbox_t *self, const char *address, const char *subject, zmsg_t **message_p);
+
+//  Send queued replies through 'client', one per recipient in turn, as long
+//  as the pipe to the malamute client actor accepts them without blocking.
+//  This does not see a slow recipient, the broker queues for those.
+//  Returns number of replies still queued
+FTY_METRIC_CACHE_EXPORT size_t
+    outbox_flush (outbox_t *self, mlm_client_t *client);
+
+//  Get number of queued replies
+FTY_METRIC_CACHE_EXPORT size_t
+    outbox_size (outbox_t *self);
+
+//  Log number of sent and dropped replies and their latency since the
+//  previous report
+FTY_METRIC_CACHE_EXPORT void
+    outbox_report (outbox_t *self);
+
+//  Destroy the outbox with queued replies
+FTY_METRIC_CACHE_EXPORT void
+    outbox_destroy (outbox_t **self_p);
+
+//  Self test of this class
+FTY_METRIC_CACHE_PRIVATE void
+    outbox_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
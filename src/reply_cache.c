@@ -0,0 +1,529 @@
+/*  =========================================================================
+    reply_cache - replies shared by identical requests
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    reply_cache - replies shared by identical requests
+@discuss
+    Many clients polling the same data send identical requests within a few
+    milliseconds. The reply body (everything but uuid) is computed for the
+    first one and copied for the others, as long as the store did not change
+    since (its generation is the same) and the reply is not older than the
+    window, which bounds staleness of time dependent parts like expiry.
+
+    Replies to GET are also kept beyond that, validated by generations of
+    the devices they cover: any update of a covered device, addition or
+    removal of a device, an element gaining or losing totals, or expiry of a
+    measurement in the reply makes the reply stale, which is found out
+    lazily when it is looked up again.
+@end
+*/
+
+#include "fty_metric_cache_classes.h"
+
+//  Reply body shared by identical requests
+
+typedef struct {
+    zmsg_t *body;
+    int64_t created;        // zclock_mono () when it was computed
+} s_entry_t;
+
+static void
+s_entry_destroy (s_entry_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    s_entry_t *self = *self_p;
+    zmsg_destroy (&self->body);
+    free (self);
+    *self_p = NULL;
+}
+
+//  Reply body valid as long as the devices it covers do not change
+
+typedef struct {
+    zmsg_t *body;
+    zhashx_t *devices;      // hash ("device name", uint64_t* generation)
+    uint64_t membership;    // generation of the set of devices
+    uint64_t topology;      // generation of the set of elements with totals
+    uint64_t expiry;        // time when the first measurement in the reply
+                            // expires, 0 for none
+    int64_t used;           // zclock_mono () when it was last looked up
+} s_covered_t;
+
+static void
+s_covered_destroy (s_covered_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    s_covered_t *self = *self_p;
+    zmsg_destroy (&self->body);
+    zhashx_destroy (&self->devices);
+    free (self);
+    *self_p = NULL;
+}
+
+static void
+s_generation_destroy (uint64_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    free (*self_p);
+    *self_p = NULL;
+}
+
+static bool
+s_covered_valid (s_covered_t *self, rt_t *data, uint64_t now_s)
+{
+    if (self->membership != rt_get_devices_generation (data)
+    ||  self->topology != rt_get_totals_generation (data))
+        return false;
+    if (self->expiry && now_s >= self->expiry)
+        return false;
+    uint64_t *generation = (uint64_t *) zhashx_first (self->devices);
+    while (generation) {
+        rt_device_t *device = (rt_device_t *) zhashx_lookup (data->devices, (const char *) zhashx_cursor (self->devices));
+        if (!device || device->generation != *generation)
+            return false;
+        generation = (uint64_t *) zhashx_next (self->devices);
+    }
+    return true;
+}
+
+//  Structure of our class
+
+struct _reply_cache_t {
+    zhashx_t *entries;      // hash ("key", s_entry_t*)
+    zhashx_t *covered;      // hash ("key", s_covered_t*), replies to GET
+    size_t limit;           // entries at most
+    int64_t window;         // ms an entry is shared at most
+    uint64_t generation;    // of the store the entries were computed at
+    uint64_t hits;          // replies shared since the last report
+    uint64_t misses;        // replies computed since the last report
+    uint64_t covered_hits;  // replies to GET served from 'covered'
+};
+
+//  --------------------------------------------------------------------------
+//  Create a new reply_cache
+
+reply_cache_t *
+reply_cache_new (size_t limit, int64_t window)
+{
+    reply_cache_t *self = (reply_cache_t *) zmalloc (sizeof (reply_cache_t));
+    assert (self);
+    self->entries = zhashx_new ();
+    zhashx_set_destructor (self->entries, (zhashx_destructor_fn *) s_entry_destroy);
+    self->covered = zhashx_new ();
+    zhashx_set_destructor (self->covered, (zhashx_destructor_fn *) s_covered_destroy);
+    self->limit = limit > 0 ? limit : 1;
+    self->window = window;
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the reply_cache
+
+void
+reply_cache_destroy (reply_cache_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    reply_cache_t *self = *self_p;
+    zhashx_destroy (&self->entries);
+    zhashx_destroy (&self->covered);
+    free (self);
+    *self_p = NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Get key of request made of all its frames
+
+char *
+reply_cache_key (zmsg_t *request)
+{
+    assert (request);
+
+    // frames are prefixed by their size, so that no content is ambiguous
+    size_t length = 1;
+    zframe_t *frame = zmsg_first (request);
+    while (frame) {
+        length += 21 + zframe_size (frame);
+        frame = zmsg_next (request);
+    }
+    char *key = (char *) zmalloc (length);
+    assert (key);
+    char *end = key;
+    frame = zmsg_first (request);
+    while (frame) {
+        end += sprintf (end, "%zu:", zframe_size (frame));
+        memcpy (end, zframe_data (frame), zframe_size (frame));
+        end += zframe_size (frame);
+        frame = zmsg_next (request);
+    }
+    *end = '\0';
+    return key;
+}
+
+//  --------------------------------------------------------------------------
+//  Get copy of reply body to request 'key'
+
+zmsg_t *
+reply_cache_get (reply_cache_t *self, const char *key, uint64_t generation)
+{
+    assert (self);
+    assert (key);
+
+    // any change of the store makes all replies stale
+    if (generation != self->generation) {
+        zhashx_purge (self->entries);
+        self->generation = generation;
+    }
+    s_entry_t *entry = (s_entry_t *) zhashx_lookup (self->entries, key);
+    if (entry && zclock_mono () - entry->created > self->window) {
+        zhashx_delete (self->entries, key);
+        entry = NULL;
+    }
+    if (!entry) {
+        self->misses++;
+        return NULL;
+    }
+    self->hits++;
+    return zmsg_dup (entry->body);
+}
+
+//  --------------------------------------------------------------------------
+//  Store reply body to request 'key'
+
+void
+reply_cache_put (reply_cache_t *self, const char *key, zmsg_t **body_p)
+{
+    assert (self);
+    assert (key);
+    assert (body_p && *body_p);
+
+    int64_t now = zclock_mono ();
+    if (zhashx_size (self->entries) >= self->limit) {
+        // make room by forgetting what expired, or everything
+        zlistx_t *expired = zlistx_new ();
+        s_entry_t *entry = (s_entry_t *) zhashx_first (self->entries);
+        while (entry) {
+            if (now - entry->created > self->window)
+                zlistx_add_end (expired, (void *) zhashx_cursor (self->entries));
+            entry = (s_entry_t *) zhashx_next (self->entries);
+        }
+        const char *expired_key = (const char *) zlistx_first (expired);
+        while (expired_key) {
+            zhashx_delete (self->entries, expired_key);
+            expired_key = (const char *) zlistx_next (expired);
+        }
+        zlistx_destroy (&expired);
+        if (zhashx_size (self->entries) >= self->limit)
+            zhashx_purge (self->entries);
+    }
+
+    s_entry_t *entry = (s_entry_t *) zmalloc (sizeof (s_entry_t));
+    assert (entry);
+    entry->body = *body_p;
+    *body_p = NULL;
+    entry->created = now;
+    zhashx_update (self->entries, key, entry);
+}
+
+//  --------------------------------------------------------------------------
+//  Get copy of reply body to request 'key' if devices it covers did not change
+
+zmsg_t *
+reply_cache_lookup (reply_cache_t *self, const char *key, rt_t *data)
+{
+    assert (self);
+    assert (key);
+    assert (data);
+
+    s_covered_t *covered = (s_covered_t *) zhashx_lookup (self->covered, key);
+    if (!covered)
+        return NULL;
+    if (!s_covered_valid (covered, data, (uint64_t) time (NULL))) {
+        zhashx_delete (self->covered, key);
+        return NULL;
+    }
+    covered->used = zclock_mono ();
+    self->covered_hits++;
+    return zmsg_dup (covered->body);
+}
+
+//  --------------------------------------------------------------------------
+//  Store reply body to request 'key' covering 'devices' until 'expiry'
+
+void
+reply_cache_store (reply_cache_t *self, const char *key, rt_t *data, zlistx_t *devices, uint64_t expiry, zmsg_t **body_p)
+{
+    assert (self);
+    assert (key);
+    assert (data);
+    assert (devices);
+    assert (body_p && *body_p);
+
+    uint64_t now_s = (uint64_t) time (NULL);
+    if (zhashx_size (self->covered) >= self->limit) {
+        // make room by forgetting what is stale, or the least recently used
+        zlistx_t *stale = zlistx_new ();
+        const char *unused = NULL;
+        int64_t unused_at = INT64_MAX;
+        s_covered_t *covered = (s_covered_t *) zhashx_first (self->covered);
+        while (covered) {
+            const char *covered_key = (const char *) zhashx_cursor (self->covered);
+            if (!s_covered_valid (covered, data, now_s))
+                zlistx_add_end (stale, (void *) covered_key);
+            else
+            if (covered->used < unused_at) {
+                unused = covered_key;
+                unused_at = covered->used;
+            }
+            covered = (s_covered_t *) zhashx_next (self->covered);
+        }
+        if (zlistx_size (stale) == 0 && unused)
+            zlistx_add_end (stale, (void *) unused);
+        const char *stale_key = (const char *) zlistx_first (stale);
+        while (stale_key) {
+            zhashx_delete (self->covered, stale_key);
+            stale_key = (const char *) zlistx_next (stale);
+        }
+        zlistx_destroy (&stale);
+    }
+
+    s_covered_t *covered = (s_covered_t *) zmalloc (sizeof (s_covered_t));
+    assert (covered);
+    covered->devices = zhashx_new ();
+    zhashx_set_destructor (covered->devices, (zhashx_destructor_fn *) s_generation_destroy);
+    covered->membership = rt_get_devices_generation (data);
+    covered->topology = rt_get_totals_generation (data);
+    covered->expiry = expiry;
+    const char *name = (const char *) zlistx_first (devices);
+    while (name) {
+        rt_device_t *device = rt_get_device_info (data, name);
+        if (device) {
+            uint64_t *generation = (uint64_t *) zmalloc (sizeof (uint64_t));
+            assert (generation);
+            *generation = device->generation;
+            if (zhashx_insert (covered->devices, name, generation) != 0)
+                free (generation);
+        }
+        name = (const char *) zlistx_next (devices);
+    }
+    covered->body = *body_p;
+    *body_p = NULL;
+    covered->used = zclock_mono ();
+    zhashx_update (self->covered, key, covered);
+}
+
+//  --------------------------------------------------------------------------
+//  Log number of shared and computed replies since the previous report
+
+void
+reply_cache_report (reply_cache_t *self)
+{
+    assert (self);
+
+    log_debug ("Replies shared %" PRIu64 ", not shared %" PRIu64 ", of all served unchanged %" PRIu64,
+            self->hits, self->misses, self->covered_hits);
+    self->hits = 0;
+    self->covered_hits = 0;
+    self->misses = 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+reply_cache_test (bool verbose)
+{
+    ftylog_setInstance ("reply_cache", "");
+
+    if (verbose)
+        ftylog_setVeboseMode (ftylog_getInstance ());
+
+    //  @selftest
+    reply_cache_t *cache = reply_cache_new (2, 100);
+    assert (cache);
+
+    zmsg_t *request = zmsg_new ();
+    zmsg_addstr (request, "GET");
+    zmsg_addstr (request, "ups-1");
+    char *key = reply_cache_key (request);
+    assert (streq (key, "3:GET5:ups-1"));
+    zmsg_destroy (&request);
+
+    // frames are not confused with their concatenation
+    request = zmsg_new ();
+    zmsg_addstr (request, "GET");
+    zmsg_addstr (request, "ups-");
+    zmsg_addstr (request, "1");
+    char *other = reply_cache_key (request);
+    assert (!streq (key, other));
+    zmsg_destroy (&request);
+
+    assert (reply_cache_get (cache, key, 1) == NULL);
+    zmsg_t *body = zmsg_new ();
+    zmsg_addstr (body, "OK");
+    zmsg_addstr (body, "ups-1");
+    reply_cache_put (cache, key, &body);
+    assert (body == NULL);
+
+    // shared while the store does not change
+    body = reply_cache_get (cache, key, 1);
+    assert (body);
+    assert (zmsg_size (body) == 2);
+    char *value = zmsg_popstr (body);
+    assert (streq (value, "OK"));
+    zstr_free (&value);
+    zmsg_destroy (&body);
+    assert (reply_cache_get (cache, other, 1) == NULL);
+
+    // any change of the store makes it stale
+    assert (reply_cache_get (cache, key, 2) == NULL);
+    assert (reply_cache_get (cache, key, 1) == NULL);
+
+    // so does the time
+    body = zmsg_new ();
+    zmsg_addstr (body, "OK");
+    reply_cache_put (cache, key, &body);
+    body = reply_cache_get (cache, key, 1);
+    assert (body);
+    zmsg_destroy (&body);
+    zclock_sleep (150);
+    assert (reply_cache_get (cache, key, 1) == NULL);
+
+    // the limit is kept
+    for (int i = 0; i < 3; i++) {
+        char *key_i = zsys_sprintf ("%d", i);
+        body = zmsg_new ();
+        zmsg_addstr (body, "OK");
+        reply_cache_put (cache, key_i, &body);
+        zstr_free (&key_i);
+    }
+    assert (zhashx_size (cache->entries) <= 2);
+    reply_cache_report (cache);
+
+    // replies to GET stay valid as long as the covered devices do not change
+    {
+        rt_t *data = rt_new ();
+        fty_proto_t *metric = fty_proto_new (FTY_PROTO_METRIC);
+        fty_proto_set_type (metric, "temperature");
+        fty_proto_set_name (metric, "sensor-1");
+        fty_proto_set_unit (metric, "C");
+        fty_proto_set_value (metric, "21");
+        fty_proto_set_ttl (metric, 300);
+        fty_proto_t *copy = fty_proto_dup (metric);
+        rt_put (data, &metric);
+
+        zlistx_t *devices = zlistx_new ();
+        zlistx_add_end (devices, (void *) "sensor-1");
+        assert (reply_cache_lookup (cache, key, data) == NULL);
+        body = zmsg_new ();
+        zmsg_addstr (body, "OK");
+        reply_cache_store (cache, key, data, devices, 0, &body);
+        assert (body == NULL);
+        zlistx_destroy (&devices);
+
+        body = reply_cache_lookup (cache, key, data);
+        assert (body);
+        zmsg_destroy (&body);
+
+        // other devices do not matter, unless they are added or removed
+        metric = fty_proto_dup (copy);
+        fty_proto_set_name (metric, "sensor-2");
+        rt_put (data, &metric);
+        assert (reply_cache_lookup (cache, key, data) == NULL);
+        devices = zlistx_new ();
+        zlistx_add_end (devices, (void *) "sensor-1");
+        body = zmsg_new ();
+        zmsg_addstr (body, "OK");
+        reply_cache_store (cache, key, data, devices, 0, &body);
+        metric = fty_proto_dup (copy);
+        fty_proto_set_name (metric, "sensor-2");
+        fty_proto_set_value (metric, "22");
+        rt_put (data, &metric);
+        body = reply_cache_lookup (cache, key, data);
+        assert (body);
+        zmsg_destroy (&body);
+
+        // any update of a covered device, even a refresh, makes it stale
+        metric = fty_proto_dup (copy);
+        rt_put (data, &metric);
+        assert (reply_cache_lookup (cache, key, data) == NULL);
+
+        // so does expiry of a measurement in the reply
+        uint64_t now_s = (uint64_t) time (NULL);
+        body = zmsg_new ();
+        zmsg_addstr (body, "OK");
+        reply_cache_store (cache, key, data, devices, now_s + 300, &body);
+        body = reply_cache_lookup (cache, key, data);
+        assert (body);
+        zmsg_destroy (&body);
+        body = zmsg_new ();
+        zmsg_addstr (body, "OK");
+        reply_cache_store (cache, key, data, devices, now_s, &body);
+        assert (reply_cache_lookup (cache, key, data) == NULL);
+
+        // and totals appearing for an element, e.g. a rack without metrics
+        rt_set_topology (data, "temperature");
+        metric = fty_proto_dup (copy);
+        fty_proto_set_name (metric, "sensor-3");
+        rt_put (data, &metric);
+        zlistx_t *none = zlistx_new ();
+        body = zmsg_new ();
+        zmsg_addstr (body, "OK");
+        reply_cache_store (cache, key, data, none, 0, &body);
+        body = reply_cache_lookup (cache, key, data);
+        assert (body);
+        zmsg_destroy (&body);
+        zlistx_t *ancestors = zlistx_new ();
+        zlistx_add_end (ancestors, (void *) "rack-1");
+        rt_set_parents (data, "sensor-3", ancestors);
+        zlistx_destroy (&ancestors);
+        assert (rt_get_totals (data, "rack-1"));
+        assert (reply_cache_lookup (cache, key, data) == NULL);
+        zlistx_destroy (&none);
+
+        // the least recently used reply makes room for a new one
+        for (int i = 0; i < 3; i++) {
+            char *key_i = zsys_sprintf ("%d", i);
+            body = zmsg_new ();
+            zmsg_addstr (body, "OK");
+            reply_cache_store (cache, key_i, data, devices, 0, &body);
+            zstr_free (&key_i);
+            zclock_sleep (2);
+        }
+        assert (zhashx_size (cache->covered) == 2);
+        assert (zhashx_lookup (cache->covered, "0") == NULL);
+
+        zlistx_destroy (&devices);
+        fty_proto_destroy (&copy);
+        rt_destroy (&data);
+    }
+
+    zstr_free (&other);
+    zstr_free (&key);
+    reply_cache_destroy (&cache);
+    reply_cache_destroy (&cache);
+    //  @end
+    log_info ("OK\n");
+}
@@ -0,0 +1,85 @@
+/*  =========================================================================
+    reply_cache - replies shared by identical requests
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef REPLY_CACHE_H_INCLUDED
+#define REPLY_CACHE_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+
+//  Create a new cache of at most 'limit' replies, each shared for 'window' ms
+//  at most
+FTY_METRIC_CACHE_EXPORT reply_cache_t *
+    reply_cache_new (size_t limit, int64_t window);
+
+//  Get key of request made of all its frames (without uuid)
+//  Caller owns the returned string
+FTY_METRIC_CACHE_EXPORT char *
+    reply_cache_key (zmsg_t *request);
+
+//  Get copy of reply body (without uuid) to request 'key' computed at
+//  'generation' of the store, NULL when there is none
+//  Caller owns the returned message
+FTY_METRIC_CACHE_EXPORT zmsg_t *
+    reply_cache_get (reply_cache_t *self, const char *key, uint64_t generation);
+
+//  Store reply body (without uuid) to request 'key', transfering ownership
+//  The reply is valid for the generation given to the last reply_cache_get
+FTY_METRIC_CACHE_EXPORT void
+    reply_cache_put (reply_cache_t *self, const char *key, zmsg_t **body_p);
+
+//  Get copy of reply body (without uuid) to GET request 'key' as long as no
+//  device it covers was updated, no device was added or removed, no element
+//  gained or lost totals and no measurement in it expired since it was
+//  stored, NULL otherwise
+//  Caller owns the returned message
+FTY_METRIC_CACHE_EXPORT zmsg_t *
+    reply_cache_lookup (reply_cache_t *self, const char *key, rt_t *data);
+
+//  Store reply body (without uuid) to GET request 'key' covering 'devices'
+//  (list of names) of 'data', transfering ownership. 'expiry' is the time
+//  when the first measurement in the reply expires, 0 for none. When the
+//  cache is full, stale replies or the least recently used one are forgotten.
+FTY_METRIC_CACHE_EXPORT void
+    reply_cache_store (reply_cache_t *self, const char *key, rt_t *data, zlistx_t *devices, uint64_t expiry, zmsg_t **body_p);
+
+//  Log number of shared and computed replies since the previous report
+FTY_METRIC_CACHE_EXPORT void
+    reply_cache_report (reply_cache_t *self);
+
+//  Destroy the cache
+FTY_METRIC_CACHE_EXPORT void
+    reply_cache_destroy (reply_cache_t **self_p);
+
+//  Self test of this class
+FTY_METRIC_CACHE_PRIVATE void
+    reply_cache_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,9 +28,273 @@
 
 #include "fty_metric_cache_classes.h"
 
-//  Structure of our class
+//  Characters which make a name a regex rather than a literal name.
+//  Asset names never contain any of them, so a name without them can only
+//  match itself and the lookup stays a single hash probe.
+#define REGEX_METACHARACTERS ".[]()*+?{}|^$\\"
 
+//  Fixed size of fty_proto_t, which is opaque. Codecs generated by zproject
+//  keep string fields in fixed 256 bytes arrays, about ten of them in
+//  fty_proto, so the length of the strings does not change it. Entries of
+//  aux and ext hashes are allocated and counted on top of it.
+#define PROTO_SIZE 2600
 
+//  Evictions are logged at most once per this many milliseconds
+#define EVICTIONS_LOG_INTERVAL 60000
+
+//  Ring of samples, allocated as one block with the arrays behind the header
+
+static rt_history_t *
+s_history_new (size_t capacity)
+{
+    rt_history_t *self = (rt_history_t *) zmalloc (
+            sizeof (rt_history_t) + capacity * (sizeof (uint64_t) + sizeof (double)));
+    assert (self);
+    self->times = (uint64_t *) (self + 1);
+    self->values = (double *) (self->times + capacity);
+    self->capacity = capacity;
+    return self;
+}
+
+static void
+s_history_push (rt_history_t *self, uint64_t time, double value)
+{
+    self->times [self->next] = time;
+    self->values [self->next] = value;
+    self->next = (self->next + 1) % self->capacity;
+    if (self->size < self->capacity)
+        self->size++;
+}
+
+//  Ring of 'count' buckets of 'length' seconds, the one of a period is at
+//  index period % count. Adding a sample is O(1), old buckets are reused.
+
+static void
+s_buckets_add (rt_bucket_t *buckets, size_t count, uint32_t length, uint64_t time, double value)
+{
+    uint32_t period = (uint32_t) (time / length);
+    rt_bucket_t *bucket = &buckets [period % count];
+    if (bucket->period > period)
+        return;     // out of order sample which is no longer in the window
+    if (bucket->period < period || bucket->count == 0) {
+        bucket->period = period;
+        bucket->count = 0;
+        bucket->min = value;
+        bucket->max = value;
+        bucket->sum = 0;
+    }
+    bucket->count++;
+    bucket->sum += value;
+    if (value < bucket->min)
+        bucket->min = value;
+    if (value > bucket->max)
+        bucket->max = value;
+}
+
+static void
+s_buckets_get (rt_bucket_t *buckets, size_t count, uint32_t length, uint64_t now_s, rt_bucket_t *result)
+{
+    uint32_t now = (uint32_t) (now_s / length);
+    memset (result, 0, sizeof (rt_bucket_t));
+    result->min = NAN;
+    result->max = NAN;
+    for (size_t i = 0; i < count; i++) {
+        rt_bucket_t *bucket = &buckets [i];
+        if (bucket->count == 0 || bucket->period > now || now - bucket->period >= count)
+            continue;
+        if (result->count == 0 || bucket->min < result->min)
+            result->min = bucket->min;
+        if (result->count == 0 || bucket->max > result->max)
+            result->max = bucket->max;
+        result->count += bucket->count;
+        result->sum += bucket->sum;
+    }
+}
+
+//  Record of one measurement
+
+static rt_metric_t *
+s_metric_new (void)
+{
+    rt_metric_t *self = (rt_metric_t *) zmalloc (sizeof (rt_metric_t));
+    assert (self);
+    return self;
+}
+
+static void
+s_metric_destroy (rt_metric_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    rt_metric_t *self = *self_p;
+    fty_proto_destroy (&self->proto);
+    free (self->history);
+    free (self->rollup);
+    free (self);
+    *self_p = NULL;
+}
+
+//  Record the current value in history and rollups of the record
+
+static void
+s_metric_sample (rt_metric_t *self)
+{
+    if (isnan (self->value))
+        return;
+    uint64_t time = fty_proto_time (self->proto);
+    if (self->history)
+        s_history_push (self->history, time, self->value);
+    if (self->rollup) {
+        s_buckets_add (self->rollup->short_term, 6, 10, time, self->value);
+        s_buckets_add (self->rollup->long_term, 15, 60, time, self->value);
+    }
+}
+
+//  Return true if hashes of strings have the same items, NULL being empty
+
+static bool
+s_hash_equal (zhash_t *one, zhash_t *two)
+{
+    size_t size_one = one ? zhash_size (one) : 0;
+    size_t size_two = two ? zhash_size (two) : 0;
+    if (size_one != size_two)
+        return false;
+    if (size_one == 0)
+        return true;
+    const char *item = (const char *) zhash_first (one);
+    while (item) {
+        const char *other = (const char *) zhash_lookup (two, zhash_cursor (one));
+        if (!other || !streq (item, other))
+            return false;
+        item = (const char *) zhash_next (one);
+    }
+    return true;
+}
+
+//  Refresh only time and ttl of the record when message repeats its value,
+//  unit, aux and ext, the message is destroyed then. Return true if refreshed.
+
+static bool
+s_metric_refresh (rt_metric_t *self, fty_proto_t **message_p)
+{
+    fty_proto_t *message = *message_p;
+    const char *value = fty_proto_value (message);
+    const char *unit = fty_proto_unit (message);
+    if (!value || !unit
+    ||  !streq (value, fty_proto_value (self->proto))
+    ||  !streq (unit, fty_proto_unit (self->proto))
+    ||  !s_hash_equal (fty_proto_aux (message), fty_proto_aux (self->proto))
+    ||  !s_hash_equal (fty_proto_ext (message), fty_proto_ext (self->proto)))
+        return false;
+
+    fty_proto_set_time (self->proto, fty_proto_time (message));
+    fty_proto_set_ttl (self->proto, fty_proto_ttl (message));
+    fty_proto_destroy (message_p);
+    s_metric_sample (self);
+    return true;
+}
+
+//  Memory used by keys and values of a hash of strings
+
+static size_t
+s_hash_size (zhash_t *hash)
+{
+    size_t size = 0;
+    if (!hash)
+        return size;
+    const char *item = (const char *) zhash_first (hash);
+    while (item) {
+        size += strlen (zhash_cursor (hash)) + strlen (item) + 2;
+        item = (const char *) zhash_next (hash);
+    }
+    return size;
+}
+
+//  Set new message to the record, parsing the value only once here
+
+static void
+s_metric_set (rt_metric_t *self, fty_proto_t **message_p)
+{
+    fty_proto_destroy (&self->proto);
+    self->proto = *message_p;
+    *message_p = NULL;
+
+    const char *value = fty_proto_value (self->proto);
+    char *end = NULL;
+    self->value = value ? strtod (value, &end) : NAN;
+    if (!value || end == value || *end != '\0')
+        self->value = NAN;
+
+    s_metric_sample (self);
+
+    // with copies of the names keying the record in its device and the index
+    self->size = sizeof (rt_metric_t) + PROTO_SIZE
+        + strlen (fty_proto_name (self->proto)) + strlen (fty_proto_type (self->proto)) + 2;
+    if (self->history)
+        self->size += sizeof (rt_history_t) + self->history->capacity * (sizeof (uint64_t) + sizeof (double));
+    if (self->rollup)
+        self->size += sizeof (rt_rollup_t);
+    self->size += s_hash_size (fty_proto_aux (self->proto));
+    self->size += s_hash_size (fty_proto_ext (self->proto));
+}
+
+static uint64_t
+s_metric_expiry (rt_metric_t *self)
+{
+    return fty_proto_time (self->proto) + fty_proto_ttl (self->proto);
+}
+
+//  Device with summary of its measurements
+
+static rt_device_t *
+s_device_new (void)
+{
+    rt_device_t *self = (rt_device_t *) zmalloc (sizeof (rt_device_t));
+    assert (self);
+    self->metrics = zhashx_new ();
+    zhashx_set_destructor (self->metrics, (zhashx_destructor_fn *) s_metric_destroy);
+    self->window_start = zclock_time ();
+    return self;
+}
+
+static void
+s_device_destroy (rt_device_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    rt_device_t *self = *self_p;
+    zhashx_destroy (&self->metrics);
+    free (self);
+    *self_p = NULL;
+}
+
+static void
+s_device_update_expiry (rt_device_t *self)
+{
+    self->earliest_expiry = 0;
+    rt_metric_t *metric = (rt_metric_t *) zhashx_first (self->metrics);
+    while (metric) {
+        uint64_t expiry = s_metric_expiry (metric);
+        if (self->earliest_expiry == 0 || expiry < self->earliest_expiry)
+            self->earliest_expiry = expiry;
+        metric = (rt_metric_t *) zhashx_next (self->metrics);
+    }
+}
+
+//  Regex matching the whole of a name, NULL if 'pattern' is not valid
+
+static zrex_t *
+s_rex_new (const char *pattern)
+{
+    char *anchored = zsys_sprintf ("^%s$", pattern);
+    zrex_t *rex = zrex_new (anchored);
+    zstr_free (&anchored);
+    if (!zrex_valid (rex)) {
+        log_debug ("'%s' is not a valid regex: %s", pattern, zrex_strerror (rex));
+        zrex_destroy (&rex);
+    }
+    return rex;
+}
 
 //  --------------------------------------------------------------------------
 //  Create a new rt
@@ -42,7 +306,15 @@ rt_new (void)
     assert (self);
 
     self->devices = zhashx_new ();
-    zhashx_set_destructor (self->devices, (zhashx_destructor_fn *) zhashx_destroy);
+    zhashx_set_destructor (self->devices, (zhashx_destructor_fn *) s_device_destroy);
+    self->types = zhashx_new ();
+    zhashx_set_destructor (self->types, (zhashx_destructor_fn *) zhashx_destroy);
+    // values are owned by self->devices
+    self->lru = zlistx_new ();
+    self->parents = zhashx_new ();
+    zhashx_set_destructor (self->parents, (zhashx_destructor_fn *) zlistx_destroy);
+    self->totals = zhashx_new ();
+    zhashx_set_destructor (self->totals, (zhashx_destructor_fn *) zhashx_destroy);
     return self;
 }
 
@@ -57,13 +329,151 @@ rt_destroy (rt_t **self_p)
     if (*self_p) {
         rt_t *self = *self_p;
 
+        zhashx_destroy (&self->types);
         zhashx_destroy (&self->devices);
+        zlistx_destroy (&self->lru);
+        zhashx_destroy (&self->totals);
+        zhashx_destroy (&self->parents);
+        zrex_destroy (&self->topology_rex);
+        zstr_free (&self->devices_list);
+        zrex_destroy (&self->history_rex);
+        zrex_destroy (&self->rollup_rex);
+        zrex_destroy (&self->counter_rex);
+        shm_view_destroy (&self->view);
 
         free (self);
         *self_p = NULL;
     }
 }
 
+static rt_device_t *
+    s_put_device (rt_t *self, rt_device_t *device, fty_proto_t **message_p, bool derive);
+static void
+    s_put (rt_t *self, fty_proto_t **message_p, bool derive);
+static void
+    s_evict (rt_t *self);
+
+//  Store '<type>.rate' of counter 'metric' of 'device' which had 'value' at
+//  'time' before
+
+static void
+s_put_rate (rt_t *self, rt_device_t *device, rt_metric_t *metric, double value, uint64_t time)
+{
+    uint64_t now = fty_proto_time (metric->proto);
+    if (isnan (value) || isnan (metric->value) || now <= time)
+        return;
+
+    // counter was reset and counts from zero again
+    double increase = metric->value >= value ? metric->value - value : metric->value;
+
+    fty_proto_t *rate = fty_proto_new (FTY_PROTO_METRIC);
+    fty_proto_set_type (rate, "%s.rate", fty_proto_type (metric->proto));
+    fty_proto_set_name (rate, "%s", fty_proto_name (metric->proto));
+    fty_proto_set_unit (rate, "%s/s", fty_proto_unit (metric->proto));
+    fty_proto_set_value (rate, "%.15g", increase / (now - time));
+    fty_proto_set_time (rate, now);
+    fty_proto_set_ttl (rate, fty_proto_ttl (metric->proto));
+    s_put_device (self, device, &rate, false);
+}
+
+//  Note that an element gained or lost totals
+
+static void
+s_totals_changed (rt_t *self)
+{
+    self->totals_generation = ++self->device_generation;
+}
+
+//  Move contribution of 'type' measurement of 'element' to totals of its
+//  ancestors from 'old' to 'value', NAN meaning no contribution. 'metric'
+//  gives time, ttl and unit of the totals, NULL keeps them.
+
+static void
+s_propagate (rt_t *self, const char *element, rt_metric_t *metric, const char *type, double old, double value)
+{
+    if (isnan (old) && isnan (value))
+        return;
+    zlistx_t *ancestors = (zlistx_t *) zhashx_lookup (self->parents, element);
+    if (!ancestors)
+        return;
+
+    const char *ancestor = (const char *) zlistx_first (ancestors);
+    while (ancestor) {
+        zhashx_t *totals = (zhashx_t *) zhashx_lookup (self->totals, ancestor);
+        rt_metric_t *total = totals ? (rt_metric_t *) zhashx_lookup (totals, type) : NULL;
+        if (!total && !isnan (value)) {
+            if (!totals) {
+                totals = zhashx_new ();
+                zhashx_set_destructor (totals, (zhashx_destructor_fn *) s_metric_destroy);
+                zhashx_insert (self->totals, ancestor, totals);
+                s_totals_changed (self);
+            }
+            total = s_metric_new ();
+            total->proto = fty_proto_new (FTY_PROTO_METRIC);
+            fty_proto_set_type (total->proto, "%s.sum", type);
+            fty_proto_set_name (total->proto, "%s", ancestor);
+            zhashx_insert (totals, type, total);
+        }
+        if (total) {
+            if (!isnan (old)) {
+                total->value -= old;
+                total->members--;
+            }
+            if (!isnan (value)) {
+                total->value += value;
+                total->members++;
+            }
+            if (total->members == 0) {
+                zhashx_delete (totals, type);
+                if (zhashx_size (totals) == 0) {
+                    zhashx_delete (self->totals, ancestor);
+                    s_totals_changed (self);
+                }
+            }
+            else {
+                if (metric) {
+                    fty_proto_set_unit (total->proto, "%s", fty_proto_unit (metric->proto));
+                    fty_proto_set_time (total->proto, fty_proto_time (metric->proto));
+                    fty_proto_set_ttl (total->proto, fty_proto_ttl (metric->proto));
+                }
+                fty_proto_set_value (total->proto, "%.15g", total->value);
+                fty_proto_aux_insert (total->proto, "count", "%zu", total->members);
+            }
+        }
+        ancestor = (const char *) zlistx_next (ancestors);
+    }
+}
+
+//  Return true if message would add a record over the limits of distinct
+//  measurements, 'device' is NULL for a new one
+
+static bool
+s_rejected (rt_t *self, rt_device_t *device, fty_proto_t *message)
+{
+    const char *type = fty_proto_type (message);
+    if (device && zhashx_lookup (device->metrics, type))
+        return false;
+
+    if (self->types_limit
+    &&  zhashx_size (self->types) >= self->types_limit
+    &&  !zhashx_lookup (self->types, type)) {
+        if (self->rejected_types++ == 0)
+            log_warning ("Limit of %zu distinct measurements reached, rejecting new ones like '%s' of '%s'",
+                    self->types_limit, type, fty_proto_name (message));
+        return true;
+    }
+    if (device
+    &&  self->element_limit
+    &&  zhashx_size (device->metrics) >= self->element_limit) {
+        if (device->rejected++ == 0)
+            log_warning ("Element '%s' reached limit of %zu measurements, rejecting new ones like '%s'",
+                    fty_proto_name (message), self->element_limit, type);
+        self->rejected_element++;
+        return true;
+    }
+    return false;
+}
+
 //  --------------------------------------------------------------------------
 //  Store fty_proto_t message transfering ownership
 
@@ -73,27 +483,226 @@ rt_put (rt_t *self, fty_proto_t **message_p)
     assert (self);
     assert (message_p);
 
-    fty_proto_t *message = *message_p;
+    s_put (self, message_p, true);
+}
+
+//  --------------------------------------------------------------------------
+//  Store fty_proto_t messages of one element transfering ownership
 
-    if (!message)
+void
+rt_put_batch (rt_t *self, zlistx_t *messages)
+{
+    assert (self);
+    assert (messages);
+
+    fty_proto_t *message = (fty_proto_t *) zlistx_detach (messages, NULL);
+    rt_device_t *device = message ?
+        (rt_device_t *) zhashx_lookup (self->devices, fty_proto_name (message)) : NULL;
+    char *element = message ? strdup (fty_proto_name (message)) : NULL;
+    while (message) {
+        if (streq (fty_proto_name (message), element))
+            device = s_put_device (self, device, &message, true);
+        else {
+            log_warning ("Metric of '%s' in batch of '%s' dropped", fty_proto_name (message), element);
+            fty_proto_destroy (&message);
+        }
+        message = (fty_proto_t *) zlistx_detach (messages, NULL);
+    }
+    zstr_free (&element);
+    // only now, so that the device stays in place for the whole batch
+    s_evict (self);
+}
+
+//  Note that the set of devices changed
+
+static void
+s_devices_changed (rt_t *self)
+{
+    zstr_free (&self->devices_list);
+    self->devices_generation = ++self->device_generation;
+}
+
+//  Store message, derive rate of counters when 'derive' is true
+
+static void
+s_put (rt_t *self, fty_proto_t **message_p, bool derive)
+{
+    if (!*message_p)
         return;
 
+    rt_device_t *device = (rt_device_t *) zhashx_lookup (self->devices, fty_proto_name (*message_p));
+    s_put_device (self, device, message_p, derive);
+    s_evict (self);
+}
+
+//  Store message of 'device' (NULL when it has no records yet) without
+//  evicting records over the memory limit, return the device or NULL when
+//  the message was rejected and there is no device
+
+static rt_device_t *
+s_put_device (rt_t *self, rt_device_t *device, fty_proto_t **message_p, bool derive)
+{
+    fty_proto_t *message = *message_p;
+
     if ( !fty_proto_time (message) ) {
         // If time not set, assign time = NOW()
         fty_proto_set_time (message, (uint64_t) zclock_time () / 1000);
     }
 
-    zhashx_t *device = (zhashx_t *) zhashx_lookup (self->devices, fty_proto_name (message));
+    if (s_rejected (self, device, message)) {
+        fty_proto_destroy (message_p);
+        return device;
+    }
     if (!device) {
-        zhashx_t *metrics = zhashx_new ();
-        zhashx_set_destructor (metrics, (zhashx_destructor_fn *) fty_proto_destroy);
+        device = s_device_new ();
+        int rv = zhashx_insert (self->devices, fty_proto_name (message), device);
+        assert (rv == 0);
+        s_devices_changed (self);
+    }
+    device->generation = ++self->device_generation;
+    device->updates++;
+    self->updates++;
+    if (fty_proto_time (message) > device->last_update)
+        device->last_update = fty_proto_time (message);
+    uint64_t expiry = fty_proto_time (message) + fty_proto_ttl (message);
+
+    rt_metric_t *metric = (rt_metric_t *) zhashx_lookup (device->metrics, fty_proto_type (message));
+    if (metric) {
+        // the earliest expiry may have moved later, find it when asked
+        if (s_metric_expiry (metric) == device->earliest_expiry)
+            device->earliest_expiry = 0;
+        else
+        if (device->earliest_expiry && expiry < device->earliest_expiry)
+            device->earliest_expiry = expiry;
+        device->bytes -= metric->size;
+        self->bytes -= metric->size;
+        bool counter = derive && self->counter_rex
+            && zrex_matches (self->counter_rex, fty_proto_type (message));
+        double value = metric->value;
+        uint64_t time = fty_proto_time (metric->proto);
+        // the record stays in place, so does its entry in the index
+        if (s_metric_refresh (metric, message_p))
+            self->refreshes++;
+        else
+            s_metric_set (metric, message_p);
+        device->bytes += metric->size;
+        self->bytes += metric->size;
+        zlistx_move_end (self->lru, metric->lru_handle);
+        if (metric->topology)
+            s_propagate (self, fty_proto_name (metric->proto), metric, fty_proto_type (metric->proto),
+                    value, metric->value);
+        if (self->view)
+            shm_view_put (self->view, metric->proto);
+        if (counter)
+            s_put_rate (self, device, metric, value, time);
+        return device;
+    }
+
+    if (zhashx_size (device->metrics) == 0 || (device->earliest_expiry && expiry < device->earliest_expiry))
+        device->earliest_expiry = expiry;
+
+    metric = s_metric_new ();
+    if (self->history_rex && zrex_matches (self->history_rex, fty_proto_type (message)))
+        metric->history = s_history_new (self->history_size);
+    if (self->rollup_rex && zrex_matches (self->rollup_rex, fty_proto_type (message))) {
+        metric->rollup = (rt_rollup_t *) zmalloc (sizeof (rt_rollup_t));
+        assert (metric->rollup);
+    }
+    metric->topology = derive && self->topology_rex
+        && zrex_matches (self->topology_rex, fty_proto_type (message));
+    int rv = zhashx_insert (device->metrics, fty_proto_type (message), metric);
+    assert (rv == 0);
 
-        int rv = zhashx_insert (self->devices, fty_proto_name (message), metrics);
+    zhashx_t *elements = (zhashx_t *) zhashx_lookup (self->types, fty_proto_type (message));
+    if (!elements) {
+        // values are owned by self->devices
+        elements = zhashx_new ();
+        rv = zhashx_insert (self->types, fty_proto_type (message), elements);
         assert (rv == 0);
-        device = metrics;
     }
-    zhashx_update (device, fty_proto_type (message), message);
-    *message_p = NULL;
+    rv = zhashx_insert (elements, fty_proto_name (message), metric);
+    assert (rv == 0);
+    s_metric_set (metric, message_p);
+    device->bytes += metric->size;
+    self->bytes += metric->size;
+    metric->lru_handle = zlistx_add_end (self->lru, metric);
+    if (self->view)
+        shm_view_put (self->view, metric->proto);
+    if (metric->topology)
+        s_propagate (self, fty_proto_name (metric->proto), metric, fty_proto_type (metric->proto),
+                NAN, metric->value);
+    return device;
+}
+
+//  Remove (element, measurement) from the index by measurement
+
+static void
+s_unindex (rt_t *self, const char *element, const char *measurement)
+{
+    zhashx_t *elements = (zhashx_t *) zhashx_lookup (self->types, measurement);
+    if (!elements)
+        return;
+    zhashx_delete (elements, element);
+    if (zhashx_size (elements) == 0)
+        zhashx_delete (self->types, measurement);
+}
+
+//  Remove (element, measurement) record of 'device', return true if the
+//  device has no records left
+
+static bool
+s_remove (rt_t *self, rt_device_t *device, const char *element, const char *measurement)
+{
+    rt_metric_t *metric = (rt_metric_t *) zhashx_lookup (device->metrics, measurement);
+    if (!metric)
+        return zhashx_size (device->metrics) == 0;
+    if (metric->topology)
+        s_propagate (self, element, NULL, measurement, metric->value, NAN);
+    s_unindex (self, element, measurement);
+    if (self->view)
+        shm_view_remove (self->view, element, measurement);
+    zlistx_delete (self->lru, metric->lru_handle);
+    device->bytes -= metric->size;
+    self->bytes -= metric->size;
+    device->generation = ++self->device_generation;
+    zhashx_delete (device->metrics, measurement);
+    return zhashx_size (device->metrics) == 0;
+}
+
+//  Evict the least recently updated records while over the memory limit
+
+static void
+s_evict (rt_t *self)
+{
+    if (self->memory_limit == 0)
+        return;
+
+    while (self->bytes > self->memory_limit && zlistx_size (self->lru) > 0) {
+        rt_metric_t *metric = (rt_metric_t *) zlistx_head (self->lru);
+        // the names are freed with the record
+        char *element = strdup (fty_proto_name (metric->proto));
+        char *measurement = strdup (fty_proto_type (metric->proto));
+        rt_device_t *device = (rt_device_t *) zhashx_lookup (self->devices, element);
+        assert (device);
+        if (s_metric_expiry (metric) == device->earliest_expiry)
+            device->earliest_expiry = 0;
+        if (s_remove (self, device, element, measurement)) {
+            zhashx_delete (self->devices, element);
+            s_devices_changed (self);
+        }
+        zstr_free (&measurement);
+        zstr_free (&element);
+        self->evictions++;
+        self->evictions_unlogged++;
+    }
+
+    int64_t now = zclock_time ();
+    if (self->evictions_unlogged > 0 && now - self->evictions_logged_at >= EVICTIONS_LOG_INTERVAL) {
+        log_warning ("Memory limit of %zu bytes reached, evicted %" PRIu64 " least recently updated metrics",
+                self->memory_limit, self->evictions_unlogged);
+        self->evictions_unlogged = 0;
+        self->evictions_logged_at = now;
+    }
 }
 
 //  --------------------------------------------------------------------------
@@ -106,10 +715,11 @@ rt_get (rt_t *self, const char *element, const char *measurement)
     assert (element);
     assert (measurement);
 
-    zhashx_t *device = (zhashx_t *) zhashx_lookup (self->devices, element);
+    rt_device_t *device = (rt_device_t *) zhashx_lookup (self->devices, element);
     if (!device)
         return NULL;
-    return (fty_proto_t *) zhashx_lookup (device, measurement);
+    rt_metric_t *metric = (rt_metric_t *) zhashx_lookup (device->metrics, measurement);
+    return metric ? metric->proto : NULL;
 }
 
 //  --------------------------------------------------------------------------
@@ -121,7 +731,320 @@ rt_get_element (rt_t *self, const char *element)
     assert (self);
     assert (element);
 
-    return (zhashx_t *) zhashx_lookup (self->devices, element);
+    rt_device_t *device = (rt_device_t *) zhashx_lookup (self->devices, element);
+    return device ? device->metrics : NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Get summary of given element or NULL when no data
+
+rt_device_t *
+rt_get_device_info (rt_t *self, const char *element)
+{
+    assert (self);
+    assert (element);
+
+    rt_device_t *device = (rt_device_t *) zhashx_lookup (self->devices, element);
+    if (device && device->earliest_expiry == 0)
+        s_device_update_expiry (device);
+    return device;
+}
+
+//  --------------------------------------------------------------------------
+//  Get the given measurement of all elements or NULL when no data
+
+zhashx_t *
+rt_get_type (rt_t *self, const char *measurement)
+{
+    assert (self);
+    assert (measurement);
+
+    return (zhashx_t *) zhashx_lookup (self->types, measurement);
+}
+
+//  Append current records of 'elements' matching 'element' to 'result'.
+//  'rex' is the compiled 'element' when it is a pattern, NULL otherwise.
+
+static void
+s_select_elements (
+        zhashx_t *elements,
+        const char *element,
+        zrex_t *rex,
+        uint64_t now_s,
+        zlistx_t *result)
+{
+    if (!elements)
+        return;
+    if (element && !rex) {
+        rt_metric_t *metric = (rt_metric_t *) zhashx_lookup (elements, element);
+        if (metric && fty_proto_time (metric->proto) + fty_proto_ttl (metric->proto) > now_s)
+            zlistx_add_end (result, metric);
+        return;
+    }
+    rt_metric_t *metric = (rt_metric_t *) zhashx_first (elements);
+    while (metric) {
+        if (fty_proto_time (metric->proto) + fty_proto_ttl (metric->proto) > now_s
+        &&  (!rex || zrex_matches (rex, (const char *) zhashx_cursor (elements))))
+            zlistx_add_end (result, metric);
+        metric = (rt_metric_t *) zhashx_next (elements);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Get list of current measurements of matching elements and types
+
+zlistx_t *
+rt_select (rt_t *self, const char *element, const char *measurement)
+{
+    assert (self);
+
+    zlistx_t *result = zlistx_new ();
+    assert (result);
+    uint64_t now_s = (uint64_t) zclock_time () / 1000;
+
+    zrex_t *element_rex = NULL;
+    if (element && rt_is_pattern (element)) {
+        element_rex = s_rex_new (element);
+        if (!element_rex)
+            return result;
+    }
+
+    if (measurement && !rt_is_pattern (measurement)) {
+        s_select_elements (
+                (zhashx_t *) zhashx_lookup (self->types, measurement),
+                element, element_rex, now_s, result);
+    }
+    else {
+        // the number of distinct types is small compared to the number of records
+        zrex_t *rex = measurement ? s_rex_new (measurement) : NULL;
+        if (!measurement || rex) {
+            zhashx_t *elements = (zhashx_t *) zhashx_first (self->types);
+            while (elements) {
+                if (!rex || zrex_matches (rex, (const char *) zhashx_cursor (self->types)))
+                    s_select_elements (elements, element, element_rex, now_s, result);
+                elements = (zhashx_t *) zhashx_next (self->types);
+            }
+        }
+        zrex_destroy (&rex);
+    }
+    zrex_destroy (&element_rex);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Get list of current measurements of one type of matching elements
+
+zlistx_t *
+rt_select_type (rt_t *self, const char *measurement, const char *element)
+{
+    assert (self);
+    assert (measurement);
+
+    zlistx_t *result = zlistx_new ();
+    assert (result);
+    zhashx_t *elements = (zhashx_t *) zhashx_lookup (self->types, measurement);
+    if (!elements)
+        return result;
+
+    zrex_t *element_rex = NULL;
+    if (element && rt_is_pattern (element)) {
+        element_rex = s_rex_new (element);
+        if (!element_rex)
+            return result;
+    }
+    s_select_elements (elements, element, element_rex, (uint64_t) zclock_time () / 1000, result);
+    zrex_destroy (&element_rex);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Keep history of measurements with types matching 'pattern'
+
+int
+rt_set_history (rt_t *self, const char *pattern, size_t size)
+{
+    assert (self);
+
+    zrex_destroy (&self->history_rex);
+    self->history_size = 0;
+    if (!pattern || size == 0)
+        return 0;
+
+    self->history_rex = s_rex_new (pattern);
+    if (!self->history_rex) {
+        log_error ("History is disabled, '%s' is not a valid regex", pattern);
+        return -1;
+    }
+    self->history_size = size;
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Get 'index'-th oldest sample of history
+
+void
+rt_history_sample (rt_history_t *history, size_t index, uint64_t *time, double *value)
+{
+    assert (history);
+    assert (index < history->size);
+
+    size_t position = (history->next + history->capacity - history->size + index) % history->capacity;
+    if (time)
+        *time = history->times [position];
+    if (value)
+        *value = history->values [position];
+}
+
+//  --------------------------------------------------------------------------
+//  Maintain rollups of measurements with types matching 'pattern'
+
+int
+rt_set_rollup (rt_t *self, const char *pattern)
+{
+    assert (self);
+
+    zrex_destroy (&self->rollup_rex);
+    if (!pattern)
+        return 0;
+
+    self->rollup_rex = s_rex_new (pattern);
+    if (!self->rollup_rex) {
+        log_error ("Rollups are disabled, '%s' is not a valid regex", pattern);
+        return -1;
+    }
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Aggregate rollup over 'window' ending at 'now_s'
+
+void
+rt_rollup_get (rt_rollup_t *rollup, int window, uint64_t now_s, rt_bucket_t *result)
+{
+    assert (rollup);
+    assert (result);
+
+    if (window == RT_ROLLUP_1M)
+        s_buckets_get (rollup->short_term, 6, 10, now_s, result);
+    else
+        s_buckets_get (rollup->long_term, 15, 60, now_s, result);
+}
+
+//  --------------------------------------------------------------------------
+//  Derive rates of counters with types matching 'pattern'
+
+int
+rt_set_counters (rt_t *self, const char *pattern)
+{
+    assert (self);
+
+    zrex_destroy (&self->counter_rex);
+    if (!pattern)
+        return 0;
+
+    self->counter_rex = s_rex_new (pattern);
+    if (!self->counter_rex) {
+        log_error ("Rates are disabled, '%s' is not a valid regex", pattern);
+        return -1;
+    }
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Limit memory used by records to 'bytes'
+
+void
+rt_set_memory_limit (rt_t *self, size_t bytes)
+{
+    assert (self);
+    self->memory_limit = bytes;
+    s_evict (self);
+}
+
+//  --------------------------------------------------------------------------
+//  Limit number of distinct measurements of an element and in total
+
+void
+rt_set_cardinality_limits (rt_t *self, size_t per_element, size_t types)
+{
+    assert (self);
+    self->element_limit = per_element;
+    self->types_limit = types;
+}
+
+//  --------------------------------------------------------------------------
+//  Keep copy of the measurements in shared memory
+
+void
+rt_set_view (rt_t *self, shm_view_t **view_p)
+{
+    assert (self);
+
+    shm_view_destroy (&self->view);
+    if (!view_p || !*view_p)
+        return;
+    self->view = *view_p;
+    *view_p = NULL;
+
+    rt_device_t *device = (rt_device_t *) zhashx_first (self->devices);
+    while (device) {
+        rt_metric_t *metric = (rt_metric_t *) zhashx_first (device->metrics);
+        while (metric) {
+            shm_view_put (self->view, metric->proto);
+            metric = (rt_metric_t *) zhashx_next (device->metrics);
+        }
+        device = (rt_device_t *) zhashx_next (self->devices);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Get generation of the set of devices
+
+uint64_t
+rt_get_devices_generation (rt_t *self)
+{
+    assert (self);
+    return self->devices_generation;
+}
+
+//  --------------------------------------------------------------------------
+//  Get generation of any change of a device, refreshes included
+
+uint64_t
+rt_get_update_generation (rt_t *self)
+{
+    assert (self);
+    return self->device_generation;
+}
+
+//  --------------------------------------------------------------------------
+//  Get generation of the set of elements with totals
+
+uint64_t
+rt_get_totals_generation (rt_t *self)
+{
+    assert (self);
+    return self->totals_generation;
+}
+
+//  --------------------------------------------------------------------------
+//  Get ratio of updates which only refreshed time and ttl
+
+double
+rt_get_refresh_ratio (rt_t *self)
+{
+    assert (self);
+    return self->updates ? (double) self->refreshes / self->updates : 0.0;
+}
+
+//  --------------------------------------------------------------------------
+//  Return true if 'name' contains a regex metacharacter
+
+bool
+rt_is_pattern (const char *name)
+{
+    assert (name);
+    return strpbrk (name, REGEX_METACHARACTERS) != NULL;
 }
 
 //  --------------------------------------------------------------------------
@@ -132,30 +1055,180 @@ rt_purge (rt_t *self)
 {
     assert (self);
     uint64_t timestamp_s = (uint64_t) zclock_time () / 1000;
-    zhashx_t *device = (zhashx_t *) zhashx_first (self->devices);
+
+    int64_t now = zclock_time ();
+    rt_device_t *device = (rt_device_t *) zhashx_first (self->devices);
     while (device) {
-        fty_proto_t *metric = (fty_proto_t *) zhashx_first (device);
+        rt_metric_t *metric = (rt_metric_t *) zhashx_first (device->metrics);
 
         zlistx_t *to_delete = zlistx_new ();
         zlistx_set_destructor (to_delete, (czmq_destructor *) zstr_free);
         zlistx_set_duplicator (to_delete, (czmq_duplicator *) strdup);
 
         while (metric) {
-            uint64_t time_s = fty_proto_time (metric);
+            uint64_t time_s = fty_proto_time (metric->proto);
 
-            if (timestamp_s - time_s > fty_proto_ttl (metric)) {
-                zlistx_add_end (to_delete, (void *) zhashx_cursor (device));
-            }
-            metric = (fty_proto_t *) zhashx_next (device);
+            if (timestamp_s - time_s > fty_proto_ttl (metric->proto))
+                zlistx_add_end (to_delete, (void *) zhashx_cursor (device->metrics));
+            metric = (rt_metric_t *) zhashx_next (device->metrics);
         }
+        const char *name = (const char *) zhashx_cursor (self->devices);
         char *cursor = (char *) zlistx_first (to_delete);
         while (cursor) {
-            zhashx_delete (device, (char *) cursor);
+            s_remove (self, device, name, cursor);
             cursor = (char *) zlistx_next (to_delete);
         }
         zlistx_destroy (&to_delete);
-        device = (zhashx_t *) zhashx_next (self->devices);
+
+        s_device_update_expiry (device);
+        if (now > device->window_start) {
+            device->update_rate = device->updates * 1000.0 / (now - device->window_start);
+            device->updates = 0;
+            device->window_start = now;
+        }
+        device = (rt_device_t *) zhashx_next (self->devices);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Drop all measurements of the element
+
+int
+rt_delete_element (rt_t *self, const char *element)
+{
+    assert (self);
+    assert (element);
+
+    rt_device_t *device = (rt_device_t *) zhashx_lookup (self->devices, element);
+    if (!device) {
+        // racks, rooms and assets whose metrics were purged have parents and
+        // totals, but no device
+        zhashx_delete (self->parents, element);
+        if (zhashx_lookup (self->totals, element)) {
+            zhashx_delete (self->totals, element);
+            s_totals_changed (self);
+        }
+        return -1;
+    }
+
+    zlistx_t *measurements = zhashx_keys (device->metrics);
+    char *measurement = (char *) zlistx_first (measurements);
+    while (measurement) {
+        s_remove (self, device, element, measurement);
+        measurement = (char *) zlistx_next (measurements);
+    }
+    zlistx_destroy (&measurements);
+    // only now, removing the measurements needed parents to update totals
+    zhashx_delete (self->parents, element);
+    if (zhashx_lookup (self->totals, element)) {
+        zhashx_delete (self->totals, element);
+        s_totals_changed (self);
+    }
+    zhashx_delete (self->devices, element);
+    s_devices_changed (self);
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Sum measurements with types matching 'pattern' into totals of ancestors
+
+int
+rt_set_topology (rt_t *self, const char *pattern)
+{
+    assert (self);
+
+    zrex_destroy (&self->topology_rex);
+    if (!pattern)
+        return 0;
+
+    self->topology_rex = s_rex_new (pattern);
+    if (!self->topology_rex) {
+        log_error ("Totals are disabled, '%s' is not a valid regex", pattern);
+        return -1;
+    }
+    return 0;
+}
+
+//  Add (or withdraw) contributions of all measurements of 'device' to totals
+
+static void
+s_contribute (rt_t *self, const char *element, rt_device_t *device, bool add)
+{
+    rt_metric_t *metric = (rt_metric_t *) zhashx_first (device->metrics);
+    while (metric) {
+        if (metric->topology)
+            s_propagate (self, element, add ? metric : NULL, (const char *) zhashx_cursor (device->metrics),
+                    add ? NAN : metric->value, add ? metric->value : NAN);
+        metric = (rt_metric_t *) zhashx_next (device->metrics);
+    }
+}
+
+//  Return true if lists of names are equal
+
+static bool
+s_names_equal (zlistx_t *one, zlistx_t *two)
+{
+    size_t size_one = one ? zlistx_size (one) : 0;
+    size_t size_two = two ? zlistx_size (two) : 0;
+    if (size_one != size_two)
+        return false;
+    if (size_one == 0)
+        return true;
+    const char *name_one = (const char *) zlistx_first (one);
+    const char *name_two = (const char *) zlistx_first (two);
+    while (name_one && name_two) {
+        if (!streq (name_one, name_two))
+            return false;
+        name_one = (const char *) zlistx_next (one);
+        name_two = (const char *) zlistx_next (two);
     }
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Set ancestors of element
+
+void
+rt_set_parents (rt_t *self, const char *element, zlistx_t *ancestors)
+{
+    assert (self);
+    assert (element);
+
+    // assets are republished on every change, mostly with the same parents
+    if (s_names_equal ((zlistx_t *) zhashx_lookup (self->parents, element), ancestors))
+        return;
+
+    rt_device_t *device = (rt_device_t *) zhashx_lookup (self->devices, element);
+    if (device)
+        s_contribute (self, element, device, false);
+
+    if (ancestors && zlistx_size (ancestors) > 0) {
+        zlistx_t *copy = zlistx_new ();
+        zlistx_set_destructor (copy, (czmq_destructor *) zstr_free);
+        const char *ancestor = (const char *) zlistx_first (ancestors);
+        while (ancestor) {
+            zlistx_add_end (copy, strdup (ancestor));
+            ancestor = (const char *) zlistx_next (ancestors);
+        }
+        zhashx_update (self->parents, element, copy);
+    }
+    else
+        zhashx_delete (self->parents, element);
+
+    if (device)
+        s_contribute (self, element, device, true);
+}
+
+//  --------------------------------------------------------------------------
+//  Get totals of element
+
+zhashx_t *
+rt_get_totals (rt_t *self, const char *element)
+{
+    assert (self);
+    assert (element);
+
+    return (zhashx_t *) zhashx_lookup (self->totals, element);
 }
 
 //  Load rt from disk
@@ -279,18 +1352,18 @@ rt_save (rt_t *self, const char *fullpath)
     /* Note: Protocol data uses 8-byte sized words, and zmsg_XXcode and file
      * functions deal with platform-dependent unsigned size_t and signed off_t
      */
-    zhashx_t *device = (zhashx_t *) zhashx_first (self->devices);
+    rt_device_t *device = (rt_device_t *) zhashx_first (self->devices);
     while (device) {
         log_debug ("%s", (const char *) zhashx_cursor (self->devices));
 
-        fty_proto_t *metric = (fty_proto_t *) zhashx_first (device);
+        rt_metric_t *metric = (rt_metric_t *) zhashx_first (device->metrics);
         while (metric) {
             uint64_t size = 0;  // Note: the zmsg_encode() and zframe_size()
                                 // below return a platform-dependent size_t,
                                 // but in protocol we use fixed uint64_t
             assert ( sizeof(size_t) <= sizeof(uint64_t) );
             zframe_t *frame = NULL;
-            fty_proto_t *duplicate = fty_proto_dup (metric);
+            fty_proto_t *duplicate = fty_proto_dup (metric->proto);
             assert (duplicate);
             zmsg_t *zmessage = fty_proto_encode (&duplicate); // duplicate destroyed here
             assert (zmessage);
@@ -327,9 +1400,9 @@ rt_save (rt_t *self, const char *fullpath)
 
             zframe_destroy (&frame);
 
-            metric = (fty_proto_t *) zhashx_next (device);
+            metric = (rt_metric_t *) zhashx_next (device->metrics);
         }
-        device = (zhashx_t *) zhashx_next (self->devices);
+        device = (rt_device_t *) zhashx_next (self->devices);
     }
 
     if (zchunk_write (chunk, zfile_handle (file)) == -1) {
@@ -349,49 +1422,56 @@ rt_print (rt_t *self)
 {
     // Note: no "if (verbose)" checks in this dedicated routine
     assert (self);
-    zhashx_t *device = (zhashx_t *) zhashx_first (self->devices);
+    rt_device_t *device = (rt_device_t *) zhashx_first (self->devices);
     while (device) {
         printf ("%s", (const char *) zhashx_cursor (self->devices));
 
-        fty_proto_t *metric = (fty_proto_t *) zhashx_first (device);
+        rt_metric_t *metric = (rt_metric_t *) zhashx_first (device->metrics);
         while (metric) {
             printf ("\t%s  -  %" PRIu64" %s %s %s %s %" PRIu32,
-                    (const char *) zhashx_cursor (device),
-                    fty_proto_time (metric),
-                    fty_proto_type (metric),
-                    fty_proto_name (metric),
-                    fty_proto_value (metric),
-                    fty_proto_unit (metric),
-                    fty_proto_ttl (metric));
-            metric = (fty_proto_t *) zhashx_next (device);
+                    (const char *) zhashx_cursor (device->metrics),
+                    fty_proto_time (metric->proto),
+                    fty_proto_type (metric->proto),
+                    fty_proto_name (metric->proto),
+                    fty_proto_value (metric->proto),
+                    fty_proto_unit (metric->proto),
+                    fty_proto_ttl (metric->proto));
+            metric = (rt_metric_t *) zhashx_next (device->metrics);
         }
-        device = (zhashx_t *) zhashx_next (self->devices);
+        device = (rt_device_t *) zhashx_next (self->devices);
     }
 }
 
 //  --------------------------------------------------------------------------
-//  Print list devices
-char *
+//  Get names of devices, each followed by newline
+const char *
 rt_get_list_devices (rt_t *self)
 {
-    char *devices = (char *) calloc(1024, sizeof(char));
-    assert(devices);
-    int limit = 1024;
-    int conter = 0;
     assert (self);
-    zhashx_t *device = (zhashx_t *) zhashx_first (self->devices);
+    if (self->devices_list)
+        return self->devices_list;
+
+    size_t length = 0;
+    rt_device_t *device = (rt_device_t *) zhashx_first (self->devices);
     while (device) {
-        conter += (strlen((const char *) zhashx_cursor (self->devices)) + 1);
-        if(conter >= limit){
-          limit += 1024;
-          devices = (char *) realloc(devices, limit);
-          assert(devices);
-        }
-        strcat(devices, (const char *) zhashx_cursor (self->devices));
-        strcat(devices, "\n");
-        device = (zhashx_t *) zhashx_next (self->devices);
+        length += strlen ((const char *) zhashx_cursor (self->devices)) + 1;
+        device = (rt_device_t *) zhashx_next (self->devices);
+    }
+
+    self->devices_list = (char *) malloc (length + 1);
+    assert (self->devices_list);
+    char *end = self->devices_list;
+    device = (rt_device_t *) zhashx_first (self->devices);
+    while (device) {
+        const char *name = (const char *) zhashx_cursor (self->devices);
+        size_t name_length = strlen (name);
+        memcpy (end, name, name_length);
+        end += name_length;
+        *end++ = '\n';
+        device = (rt_device_t *) zhashx_next (self->devices);
     }
-    return devices;
+    *end = '\0';
+    return self->devices_list;
 }
 
 
@@ -541,20 +1621,480 @@ rt_test (bool verbose)
     assert (r);
     assert (zhashx_size (r) == 3);
 
-    proto = (fty_proto_t *) zhashx_lookup (r, "temp");
+    proto = ((rt_metric_t *) zhashx_lookup (r, "temp"))->proto;
     assert (proto);
     test_assert_proto (proto, "temp", "ups", "15", "C", 20);
 
-    proto = (fty_proto_t *) zhashx_lookup (r, "ahoy");
+    proto = ((rt_metric_t *) zhashx_lookup (r, "ahoy"))->proto;
     assert (proto);
     test_assert_proto (proto, "ahoy", "ups", "90", "%", 8);
 
-    proto = (fty_proto_t *) zhashx_lookup (r, "humidity");
+    proto = ((rt_metric_t *) zhashx_lookup (r, "humidity"))->proto;
     assert (proto);
     test_assert_proto (proto, "humidity", "ups", "40", "%", 10);
 
     assert (zhashx_lookup (r, "load.input") == NULL);
 
+    // rt_get_device_info
+    assert (rt_get_device_info (self, "fsfwe") == NULL);
+    rt_device_t *info = rt_get_device_info (self, "ups");
+    assert (info);
+    assert (zhashx_size (info->metrics) == 3);
+    assert (info->last_update == fty_proto_time (rt_get (self, "ups", "ahoy")));
+    // ahoy has the shortest ttl
+    assert (info->earliest_expiry == fty_proto_time (rt_get (self, "ups", "ahoy")) + 8);
+    assert (info->bytes >= 3 * PROTO_SIZE);
+
+    // rt_get_list_devices
+    const char *list = rt_get_list_devices (self);
+    assert (strlen (list) == strlen ("ups\nepdu\nswitch\n"));
+    assert (strstr (list, "ups\n"));
+    assert (strstr (list, "epdu\n"));
+    assert (strstr (list, "switch\n"));
+    assert (rt_get_list_devices (self) == list);
+
+    // history
+    {
+        rt_t *hist = rt_new ();
+        rv = rt_set_history (hist, "(", 3);
+        assert (rv == -1);
+        rv = rt_set_history (hist, "hist.*", 3);
+        assert (rv == 0);
+        for (int i = 1; i <= 5; i++) {
+            char *value = zsys_sprintf ("%d", i);
+            fty_proto_t *sample = test_metric_new ("history", "sensor", value, "C", 20);
+            fty_proto_set_time (sample, 1000 + i);
+            zstr_free (&value);
+            rt_put (hist, &sample);
+        }
+        fty_proto_t *sample = test_metric_new ("other", "sensor", "1", "C", 20);
+        rt_put (hist, &sample);
+        zhashx_t *sensor = rt_get_element (hist, "sensor");
+        assert (((rt_metric_t *) zhashx_lookup (sensor, "other"))->history == NULL);
+
+        rt_history_t *history = ((rt_metric_t *) zhashx_lookup (sensor, "history"))->history;
+        assert (history);
+        assert (history->size == 3);
+        for (size_t i = 0; i < history->size; i++) {
+            uint64_t time;
+            double value;
+            rt_history_sample (history, i, &time, &value);
+            assert (time == 1003 + i);
+            assert (value == 3.0 + i);
+        }
+        rt_set_history (hist, NULL, 0);
+        assert (hist->history_rex == NULL);
+        rt_destroy (&hist);
+    }
+
+    // rollups
+    {
+        rt_t *roll = rt_new ();
+        rv = rt_set_rollup (roll, "load.*");
+        assert (rv == 0);
+        // 10:00:00 and 10:00:30
+        uint64_t base = 36000;
+        fty_proto_t *sample = test_metric_new ("load.input", "pdu", "10", "%", 20);
+        fty_proto_set_time (sample, base);
+        rt_put (roll, &sample);
+        sample = test_metric_new ("load.input", "pdu", "30", "%", 20);
+        fty_proto_set_time (sample, base + 30);
+        rt_put (roll, &sample);
+
+        zhashx_t *pdu = rt_get_element (roll, "pdu");
+        rt_rollup_t *rollup = ((rt_metric_t *) zhashx_lookup (pdu, "load.input"))->rollup;
+        assert (rollup);
+
+        rt_bucket_t result;
+        rt_rollup_get (rollup, RT_ROLLUP_1M, base + 40, &result);
+        assert (result.count == 2);
+        assert (result.min == 10.0 && result.max == 30.0 && result.sum == 40.0);
+
+        // 10:05:00 and late 09:59:00, which is out of the 1 minute window
+        sample = test_metric_new ("load.input", "pdu", "20", "%", 20);
+        fty_proto_set_time (sample, base + 300);
+        rt_put (roll, &sample);
+        sample = test_metric_new ("load.input", "pdu", "90", "%", 20);
+        fty_proto_set_time (sample, base - 60);
+        rt_put (roll, &sample);
+
+        rt_rollup_get (rollup, RT_ROLLUP_1M, base + 305, &result);
+        assert (result.count == 1);
+        assert (result.max == 20.0);
+
+        rt_rollup_get (rollup, RT_ROLLUP_15M, base + 305, &result);
+        assert (result.count == 4);
+        assert (result.min == 10.0 && result.max == 90.0);
+
+        rt_rollup_get (rollup, RT_ROLLUP_15M, base + 3600, &result);
+        assert (result.count == 0);
+        assert (isnan (result.max));
+        rt_destroy (&roll);
+    }
+
+    // refresh of unchanged values
+    {
+        rt_t *refresh = rt_new ();
+        assert (rt_get_refresh_ratio (refresh) == 0.0);
+        fty_proto_t *sample = test_metric_new ("status", "ups", "online", "", 20);
+        fty_proto_set_time (sample, 1000);
+        rt_put (refresh, &sample);
+        fty_proto_t *cached = rt_get (refresh, "ups", "status");
+
+        sample = test_metric_new ("status", "ups", "online", "", 30);
+        fty_proto_set_time (sample, 1010);
+        rt_put (refresh, &sample);
+        assert (sample == NULL);
+        assert (rt_get (refresh, "ups", "status") == cached);
+        assert (fty_proto_time (cached) == 1010);
+        assert (fty_proto_ttl (cached) == 30);
+        assert (rt_get_refresh_ratio (refresh) == 0.5);
+
+        sample = test_metric_new ("status", "ups", "onbattery", "", 30);
+        fty_proto_set_time (sample, 1020);
+        rt_put (refresh, &sample);
+        assert (streq (fty_proto_value (rt_get (refresh, "ups", "status")), "onbattery"));
+        assert (rt_get_refresh_ratio (refresh) == 1.0 / 3);
+
+        // the same value with other aux or ext is stored as a whole
+        sample = test_metric_new ("status", "ups", "onbattery", "", 30);
+        fty_proto_set_time (sample, 1030);
+        fty_proto_aux_insert (sample, "port", "%s", "1");
+        rt_put (refresh, &sample);
+        cached = rt_get (refresh, "ups", "status");
+        assert (streq (fty_proto_aux_string (cached, "port", ""), "1"));
+        assert (rt_get_refresh_ratio (refresh) == 1.0 / 4);
+
+        sample = test_metric_new ("status", "ups", "onbattery", "", 30);
+        fty_proto_set_time (sample, 1040);
+        fty_proto_aux_insert (sample, "port", "%s", "1");
+        rt_put (refresh, &sample);
+        assert (rt_get (refresh, "ups", "status") == cached);
+        assert (rt_get_refresh_ratio (refresh) == 2.0 / 5);
+
+        sample = test_metric_new ("status", "ups", "onbattery", "", 30);
+        fty_proto_set_time (sample, 1050);
+        fty_proto_aux_insert (sample, "port", "%s", "1");
+        fty_proto_ext_insert (sample, "source", "%s", "snmp");
+        rt_put (refresh, &sample);
+        cached = rt_get (refresh, "ups", "status");
+        assert (streq (fty_proto_ext_string (cached, "source", ""), "snmp"));
+        assert (rt_get_refresh_ratio (refresh) == 2.0 / 6);
+        rt_destroy (&refresh);
+    }
+
+    // memory limit
+    {
+        rt_t *limited = rt_new ();
+        for (int i = 0; i < 4; i++) {
+            char *type = zsys_sprintf ("type%d", i);
+            fty_proto_t *sample = test_metric_new (type, i < 2 ? "ups" : "pdu", "1", "V", 20);
+            zstr_free (&type);
+            rt_put (limited, &sample);
+        }
+        size_t size = limited->bytes / 4;
+        // update of the oldest makes it the most recent
+        fty_proto_t *sample = test_metric_new ("type0", "ups", "2", "V", 20);
+        rt_put (limited, &sample);
+        assert (limited->bytes == 4 * size);
+
+        rt_set_memory_limit (limited, 3 * size);
+        assert (limited->evictions == 1);
+        assert (rt_get (limited, "ups", "type1") == NULL);
+        assert (rt_get (limited, "ups", "type0"));
+        assert (limited->bytes == 3 * size);
+
+        // a new record evicts the least recently updated one and its device
+        sample = test_metric_new ("type4", "ups", "1", "V", 20);
+        rt_put (limited, &sample);
+        sample = test_metric_new ("type5", "ups", "1", "V", 20);
+        rt_put (limited, &sample);
+        assert (limited->evictions == 3);
+        assert (rt_get_element (limited, "pdu") == NULL);
+        assert (streq (rt_get_list_devices (limited), "ups\n"));
+        assert (limited->bytes == 3 * size);
+        assert (rt_get_device_info (limited, "ups")->bytes == 3 * size);
+        rt_destroy (&limited);
+    }
+
+    // cardinality limits
+    {
+        rt_t *limited = rt_new ();
+        rt_set_cardinality_limits (limited, 2, 3);
+        const char *puts [][2] = {
+            { "ups", "a" }, { "ups", "b" },
+            { "ups", "c" },                 // over the limit of ups
+            { "pdu", "a" }, { "pdu", "c" }, // c is the third type
+            { "sts", "d" },                 // over the limit of types
+            { "ups", "a" },                 // updates are accepted
+        };
+        for (size_t i = 0; i < sizeof (puts) / sizeof (puts [0]); i++) {
+            fty_proto_t *sample = test_metric_new (puts [i][1], puts [i][0], "1", "V", 20);
+            rt_put (limited, &sample);
+            assert (sample == NULL);
+        }
+        assert (zhashx_size (rt_get_element (limited, "ups")) == 2);
+        assert (rt_get (limited, "ups", "c") == NULL);
+        assert (zhashx_size (rt_get_element (limited, "pdu")) == 2);
+        assert (rt_get_element (limited, "sts") == NULL);
+        assert (rt_get_device_info (limited, "ups")->rejected == 1);
+        assert (limited->rejected_element == 1);
+        assert (limited->rejected_types == 1);
+        rt_destroy (&limited);
+    }
+
+    // counters
+    {
+        rt_t *counters = rt_new ();
+        rv = rt_set_counters (counters, "energy.*");
+        assert (rv == 0);
+        const char *values [] = { "100", "160", "20", "x", "50" };
+        for (int i = 0; i < 5; i++) {
+            fty_proto_t *sample = test_metric_new ("energy", "ups", values [i], "Wh", 20);
+            fty_proto_set_time (sample, 1000 + 10 * i);
+            rt_put (counters, &sample);
+            fty_proto_t *rate = rt_get (counters, "ups", "energy.rate");
+            if (i == 0) {
+                assert (rate == NULL);
+                continue;
+            }
+            assert (rate);
+            assert (streq (fty_proto_unit (rate), "Wh/s"));
+            assert (fty_proto_time (rate) == 1000 + 10 * (i < 3 ? i : 2));
+            // increase by 60, reset to 0 and increase to 20, not a number
+            assert (streq (fty_proto_value (rate), i == 1 ? "6" : "2"));
+        }
+        // the rate is not a counter itself
+        assert (rt_get (counters, "ups", "energy.rate.rate") == NULL);
+        rt_destroy (&counters);
+    }
+
+    // rt_delete_element
+    {
+        rt_t *deleted = rt_new ();
+        fty_proto_t *sample = test_metric_new ("temperature", "ups", "20", "C", 20);
+        rt_put (deleted, &sample);
+        sample = test_metric_new ("humidity", "ups", "40", "%", 20);
+        rt_put (deleted, &sample);
+        sample = test_metric_new ("temperature", "epdu", "25", "C", 20);
+        rt_put (deleted, &sample);
+        assert (streq (rt_get_list_devices (deleted), "epdu\nups\n") || streq (rt_get_list_devices (deleted), "ups\nepdu\n"));
+
+        rv = rt_delete_element (deleted, "ups");
+        assert (rv == 0);
+        assert (rt_get_element (deleted, "ups") == NULL);
+        assert (rt_get_type (deleted, "humidity") == NULL);
+        assert (zhashx_size (rt_get_type (deleted, "temperature")) == 1);
+        assert (streq (rt_get_list_devices (deleted), "epdu\n"));
+        assert (deleted->bytes == rt_get_device_info (deleted, "epdu")->bytes);
+        assert (zlistx_size (deleted->lru) == 1);
+
+        rv = rt_delete_element (deleted, "ups");
+        assert (rv == -1);
+        rt_destroy (&deleted);
+    }
+
+    // topology totals
+    {
+        rt_t *topology = rt_new ();
+        rv = rt_set_topology (topology, "realpower.*");
+        assert (rv == 0);
+        zlistx_t *ancestors = zlistx_new ();
+        zlistx_add_end (ancestors, (void *) "rack-1");
+        zlistx_add_end (ancestors, (void *) "room-1");
+        rt_set_parents (topology, "ups-1", ancestors);
+        rt_set_parents (topology, "ups-2", ancestors);
+        zlistx_destroy (&ancestors);
+
+        fty_proto_t *sample = test_metric_new ("realpower.default", "ups-1", "100", "W", 20);
+        rt_put (topology, &sample);
+        sample = test_metric_new ("realpower.default", "ups-2", "50", "W", 20);
+        rt_put (topology, &sample);
+        sample = test_metric_new ("temperature", "ups-2", "30", "C", 20);
+        rt_put (topology, &sample);
+        sample = test_metric_new ("realpower.default", "ups-1", "120", "W", 20);
+        rt_put (topology, &sample);
+
+        zhashx_t *totals = rt_get_totals (topology, "room-1");
+        assert (totals);
+        assert (zhashx_size (totals) == 1);
+        rt_metric_t *total = (rt_metric_t *) zhashx_lookup (totals, "realpower.default");
+        assert (total && total->value == 170.0 && total->members == 2);
+        test_assert_proto (total->proto, "realpower.default.sum", "room-1", "170", "W", 20);
+
+        // ups-2 moves to another rack in the same room
+        ancestors = zlistx_new ();
+        zlistx_add_end (ancestors, (void *) "rack-2");
+        zlistx_add_end (ancestors, (void *) "room-1");
+        rt_set_parents (topology, "ups-2", ancestors);
+        zlistx_destroy (&ancestors);
+        total = (rt_metric_t *) zhashx_lookup (rt_get_totals (topology, "rack-1"), "realpower.default");
+        assert (total->value == 120.0 && total->members == 1);
+        total = (rt_metric_t *) zhashx_lookup (rt_get_totals (topology, "rack-2"), "realpower.default");
+        assert (total->value == 50.0 && total->members == 1);
+        total = (rt_metric_t *) zhashx_lookup (rt_get_totals (topology, "room-1"), "realpower.default");
+        assert (total->value == 170.0 && total->members == 2);
+
+        // totals without members disappear
+        rt_delete_element (topology, "ups-1");
+        assert (rt_get_totals (topology, "rack-1") == NULL);
+        total = (rt_metric_t *) zhashx_lookup (rt_get_totals (topology, "room-1"), "realpower.default");
+        assert (total->value == 50.0 && total->members == 1);
+
+        // deleted rack without metrics of its own drops its parents and totals
+        ancestors = zlistx_new ();
+        zlistx_add_end (ancestors, (void *) "room-1");
+        rt_set_parents (topology, "rack-2", ancestors);
+        zlistx_destroy (&ancestors);
+        assert (zhashx_lookup (topology->parents, "rack-2"));
+        assert (rt_get_totals (topology, "rack-2"));
+        assert (rt_delete_element (topology, "rack-2") == -1);
+        assert (zhashx_lookup (topology->parents, "rack-2") == NULL);
+        assert (rt_get_totals (topology, "rack-2") == NULL);
+        rt_destroy (&topology);
+    }
+
+    // rt_put_batch
+    {
+        rt_t *batch = rt_new ();
+        rt_set_counters (batch, "energy");
+        zlistx_t *messages = zlistx_new ();
+        zlistx_add_end (messages, test_metric_new ("realpower.default", "epdu-1", "100", "W", 20));
+        zlistx_add_end (messages, test_metric_new ("voltage.input", "epdu-1", "230", "V", 20));
+        zlistx_add_end (messages, test_metric_new ("temperature", "someone-else", "20", "C", 20));
+        fty_proto_t *energy = test_metric_new ("energy", "epdu-1", "1000", "Wh", 20);
+        fty_proto_set_time (energy, 1000);
+        zlistx_add_end (messages, energy);
+        rt_put_batch (batch, messages);
+        assert (zlistx_size (messages) == 0);
+        assert (zhashx_size (rt_get_element (batch, "epdu-1")) == 3);
+        assert (rt_get_element (batch, "someone-else") == NULL);
+
+        // updates of the same device, counter rates included
+        energy = test_metric_new ("energy", "epdu-1", "1010", "Wh", 20);
+        fty_proto_set_time (energy, 1010);
+        zlistx_add_end (messages, energy);
+        zlistx_add_end (messages, test_metric_new ("realpower.default", "epdu-1", "110", "W", 20));
+        rt_put_batch (batch, messages);
+        assert (zhashx_size (rt_get_element (batch, "epdu-1")) == 4);
+        assert (streq (fty_proto_value (rt_get (batch, "epdu-1", "energy.rate")), "1"));
+        assert (streq (fty_proto_value (rt_get (batch, "epdu-1", "realpower.default")), "110"));
+
+        // empty batch does nothing
+        rt_put_batch (batch, messages);
+        zlistx_destroy (&messages);
+        rt_destroy (&batch);
+    }
+
+    // rt_set_view
+    {
+        rt_t *shared = rt_new ();
+        fty_proto_t *sample = test_metric_new ("realpower.default", "ups-1", "100", "W", 20);
+        rt_put (shared, &sample);
+
+        char *name = zsys_sprintf ("/fty-metric-cache-rt-test-%d", (int) getpid ());
+        shm_view_t *view = shm_view_new (name, 16);
+        assert (view);
+        // the view stays owned by the rt, keep a pointer to check it
+        shm_view_t *published = view;
+        rt_set_view (shared, &view);
+        assert (view == NULL);
+        assert (shm_view_size (published) == 1);
+
+        sample = test_metric_new ("temperature", "ups-1", "30", "C", 20);
+        rt_put (shared, &sample);
+        sample = test_metric_new ("realpower.default", "ups-1", "110", "W", 20);
+        rt_put (shared, &sample);
+        assert (shm_view_size (published) == 2);
+        rt_delete_element (shared, "ups-1");
+        assert (shm_view_size (published) == 0);
+
+        rt_set_view (shared, NULL);
+        sample = test_metric_new ("realpower.default", "ups-1", "100", "W", 20);
+        rt_put (shared, &sample);
+        zstr_free (&name);
+        rt_destroy (&shared);
+    }
+
+    // generations
+    {
+        rt_t *changes = rt_new ();
+        fty_proto_t *sample = test_metric_new ("realpower.default", "ups-1", "200", "W", 20);
+        rt_put (changes, &sample);
+        sample = test_metric_new ("realpower.default", "ups-2", "50", "W", 20);
+        rt_put (changes, &sample);
+
+        // refresh of an unchanged value is a new generation of the device,
+        // not of the others
+        uint64_t update = rt_get_update_generation (changes);
+        uint64_t devices = rt_get_devices_generation (changes);
+        uint64_t device = rt_get_device_info (changes, "ups-1")->generation;
+        uint64_t other = rt_get_device_info (changes, "ups-2")->generation;
+        sample = test_metric_new ("realpower.default", "ups-1", "200", "W", 20);
+        rt_put (changes, &sample);
+        assert (rt_get_update_generation (changes) > update);
+        assert (rt_get_device_info (changes, "ups-1")->generation > device);
+        assert (rt_get_device_info (changes, "ups-2")->generation == other);
+        assert (rt_get_devices_generation (changes) == devices);
+        sample = test_metric_new ("realpower.default", "ups-3", "1", "W", 20);
+        rt_put (changes, &sample);
+        assert (rt_get_devices_generation (changes) > devices);
+        devices = rt_get_devices_generation (changes);
+        rt_delete_element (changes, "ups-3");
+        assert (rt_get_devices_generation (changes) > devices);
+        rt_destroy (&changes);
+    }
+
+    // rt_get_type
+    r = rt_get_type (self, "fsfwe");
+    assert (r == NULL);
+    r = rt_get_type (self, "humidity");
+    assert (r);
+    assert (zhashx_size (r) == 2);
+    test_assert_proto (((rt_metric_t *) zhashx_lookup (r, "ups"))->proto, "humidity", "ups", "40", "%", 10);
+    test_assert_proto (((rt_metric_t *) zhashx_lookup (r, "epdu"))->proto, "humidity", "epdu", "21", "%", 10);
+
+    // rt_select
+    assert (rt_is_pattern ("ups-.*"));
+    assert (!rt_is_pattern ("ups-1"));
+
+    zlistx_t *selected = rt_select (self, "ups", "humidity");
+    assert (zlistx_size (selected) == 1);
+    rt_metric_t *record = (rt_metric_t *) zlistx_first (selected);
+    test_assert_proto (record->proto, "humidity", "ups", "40", "%", 10);
+    assert (record->value == 40.0);
+    zlistx_destroy (&selected);
+
+    selected = rt_select (self, NULL, "humidity");
+    assert (zlistx_size (selected) == 2);
+    zlistx_destroy (&selected);
+
+    selected = rt_select (self, "u.s", NULL);
+    assert (zlistx_size (selected) == 3);
+    zlistx_destroy (&selected);
+
+    selected = rt_select (self, ".*", "(amp|load).*");
+    assert (zlistx_size (selected) == 2);
+    zlistx_destroy (&selected);
+
+    selected = rt_select (self, "ups", "hum");
+    assert (zlistx_size (selected) == 0);
+    zlistx_destroy (&selected);
+
+    selected = rt_select (self, "(", NULL);
+    assert (zlistx_size (selected) == 0);
+    zlistx_destroy (&selected);
+
+    selected = rt_select_type (self, "humidity", "e.*");
+    assert (zlistx_size (selected) == 1);
+    record = (rt_metric_t *) zlistx_first (selected);
+    test_assert_proto (record->proto, "humidity", "epdu", "21", "%", 10);
+    zlistx_destroy (&selected);
+
+    selected = rt_select_type (self, "hum.*", NULL);
+    assert (zlistx_size (selected) == 0);
+    zlistx_destroy (&selected);
+
     // purge imediatelly, nothing should be removed
     rt_purge (self);
     proto = rt_get (self, "ups", "temp");
@@ -580,6 +2120,7 @@ rt_test (bool verbose)
     rt_put (self, &metric);
     proto = rt_get (self, "ups", "humidity");
     test_assert_proto (proto, "humidity", "ups", "33", "%", 8);
+    assert (((rt_metric_t *) zhashx_lookup (rt_get_type (self, "humidity"), "ups"))->proto == proto);
 
     // change (switch, load.input)
     metric = test_metric_new ("load.input", "switch", "1000", "kV", 21);
@@ -601,6 +2142,8 @@ rt_test (bool verbose)
 
     proto = rt_get (self, "epdu", "humidity");
     test_assert_proto (proto, "humidity", "epdu", "21", "%", 10);
+    assert (zhashx_size (rt_get_type (self, "humidity")) == 1);
+    assert (rt_get_type (self, "ahoy") == NULL);
 
     proto = rt_get (self, "switch", "load.input");
     test_assert_proto (proto, "load.input", "switch", "1000", "kV", 21);
@@ -648,6 +2191,10 @@ rt_test (bool verbose)
     proto = rt_get (self, "switch", "amperes");
     assert (proto == NULL);
 
+    // devices without data are still listed
+    assert (rt_get_element (self, "ups") && zhashx_size (rt_get_element (self, "ups")) == 0);
+    assert (strstr (rt_get_list_devices (self), "ups\n"));
+
     // purge on empty
     rt_purge (self);
 
@@ -32,6 +32,65 @@ typedef struct _rt_t rt_t;
 #define RT_T_DEFINED
 #endif
 
+//  Ring of the latest numeric samples of one measurement
+typedef struct {
+    uint64_t *times;        // 'capacity' times of samples
+    double *values;         // 'capacity' values of samples
+    size_t capacity;
+    size_t size;            // number of valid samples
+    size_t next;            // index where next sample is stored
+} rt_history_t;
+
+//  Aggregate of numeric samples within one period
+typedef struct {
+    uint32_t period;        // time of samples divided by length of period
+    uint32_t count;
+    double min;
+    double max;
+    double sum;
+} rt_bucket_t;
+
+//  Rollup windows, sliding by one bucket
+#define RT_ROLLUP_1M    0   // 1 minute as 6 buckets of 10 seconds
+#define RT_ROLLUP_15M   1   // 15 minutes as 15 buckets of 1 minute
+
+//  Rolling aggregates of one measurement, fixed size
+typedef struct {
+    rt_bucket_t short_term [6];
+    rt_bucket_t long_term [15];
+} rt_rollup_t;
+
+//  Cached measurement, owned by rt
+typedef struct {
+    fty_proto_t *proto;     // latest METRIC message
+    double value;           // value of 'proto' parsed at ingest, NAN if not a number
+    size_t size;            // approximate memory used by the record
+    rt_history_t *history;  // NULL unless the type is configured by rt_set_history
+    rt_rollup_t *rollup;    // NULL unless the type is configured by rt_set_rollup
+    void *lru_handle;       // position in the order of updates
+    bool topology;          // true if summed into totals of ancestors, see
+                            // rt_set_topology
+    size_t members;         // number of measurements summed, only for totals
+} rt_metric_t;
+
+//  Cached device with summary of its measurements, owned by rt
+//  The summary is maintained by rt_put and rt_purge
+typedef struct {
+    zhashx_t *metrics;          // hash ("measurement", rt_metric_t*)
+    uint64_t last_update;       // the latest time of its measurements
+    uint64_t earliest_expiry;   // time when the first measurement expires,
+                                // 0 when it must be recomputed
+    double update_rate;         // updates per second between the last two purges
+    size_t bytes;               // approximate memory used by the measurements
+    uint64_t updates;           // updates since 'window_start'
+    int64_t window_start;       // time of the last purge (ms)
+    uint64_t rejected;          // new measurements rejected over the limit
+                                // of rt_set_cardinality_limits
+    uint64_t generation;        // changes with every update of its measurements,
+                                // including refreshes, and every removal; unique
+                                // across devices of the store
+} rt_device_t;
+
 //  @interface
 //  Create a new rt
 FTY_METRIC_CACHE_EXPORT rt_t *
@@ -41,16 +100,116 @@ FTY_METRIC_CACHE_EXPORT rt_t *
 FTY_METRIC_CACHE_EXPORT void
     rt_put (rt_t *self, fty_proto_t **message);
 
+//  Store list of fty_proto_t messages of one element, looking the element up
+//  only once, transfering ownership of them and leaving the list empty
+//  Messages of other elements than the first one are dropped
+FTY_METRIC_CACHE_EXPORT void
+    rt_put_batch (rt_t *self, zlistx_t *messages);
+
 //  Get specific measurement for given element or NULL when no data
 //  Does not transfer ownership
 FTY_METRIC_CACHE_EXPORT fty_proto_t *
     rt_get (rt_t *self, const char *element, const char *measurement);
 
 //  Get all measurements for given element or NULL when no data
-//  Does not transfer ownership
+//  Returns hash ("measurement", rt_metric_t*), does not transfer ownership
 FTY_METRIC_CACHE_EXPORT zhashx_t *
     rt_get_element (rt_t *self, const char *element);
 
+//  Get the given measurement of all elements or NULL when no data
+//  Returns hash ("device name", rt_metric_t*), does not transfer ownership
+FTY_METRIC_CACHE_EXPORT zhashx_t *
+    rt_get_type (rt_t *self, const char *measurement);
+
+//  Get list of current (not expired) measurements of elements matching
+//  'element' with types matching 'measurement'. Both are either literal
+//  names or regexes matching the whole name (see rt_is_pattern), NULL
+//  matches everything.
+//  Returns list of rt_metric_t*, caller destroys the list but not the items
+FTY_METRIC_CACHE_EXPORT zlistx_t *
+    rt_select (rt_t *self, const char *element, const char *measurement);
+
+//  Get generation of the set of devices, it changes whenever a device is
+//  added or removed (see also generation of rt_device_t)
+FTY_METRIC_CACHE_EXPORT uint64_t
+    rt_get_devices_generation (rt_t *self);
+
+//  Get generation bumped by every change of any device, refreshes of time
+//  and ttl included
+FTY_METRIC_CACHE_EXPORT uint64_t
+    rt_get_update_generation (rt_t *self);
+
+//  Get generation of the set of elements with totals, it changes whenever
+//  an element gains or loses totals (see rt_set_parents)
+FTY_METRIC_CACHE_EXPORT uint64_t
+    rt_get_totals_generation (rt_t *self);
+
+//  Get list of current (not expired) measurements of type 'measurement' of
+//  elements matching 'element' (see rt_select).
+//  Returns list of rt_metric_t*, caller destroys the list but not the items
+FTY_METRIC_CACHE_EXPORT zlistx_t *
+    rt_select_type (rt_t *self, const char *measurement, const char *element);
+
+//  Keep history of the latest 'size' samples of measurements with types
+//  matching regex 'pattern', applies to measurements stored from now on.
+//  NULL 'pattern' or zero 'size' disables history.
+//  0 - success, -1 - invalid pattern
+FTY_METRIC_CACHE_EXPORT int
+    rt_set_history (rt_t *self, const char *pattern, size_t size);
+
+//  Get 'index'-th oldest sample of history, 'index' MUST be lower than
+//  history->size
+FTY_METRIC_CACHE_EXPORT void
+    rt_history_sample (rt_history_t *history, size_t index, uint64_t *time, double *value);
+
+//  Maintain rollups of measurements with types matching regex 'pattern',
+//  applies to measurements stored from now on. NULL 'pattern' disables them.
+//  0 - success, -1 - invalid pattern
+FTY_METRIC_CACHE_EXPORT int
+    rt_set_rollup (rt_t *self, const char *pattern);
+
+//  Aggregate rollup over 'window' (RT_ROLLUP_1M or RT_ROLLUP_15M) ending
+//  at 'now_s' into 'result', result->period is meaningless
+FTY_METRIC_CACHE_EXPORT void
+    rt_rollup_get (rt_rollup_t *rollup, int window, uint64_t now_s, rt_bucket_t *result);
+
+//  Derive '<type>.rate' measurement, the increase per second since the previous
+//  sample, for counters with types matching regex 'pattern'. A decrease of
+//  the counter is taken as its reset to zero. NULL 'pattern' disables it.
+//  0 - success, -1 - invalid pattern
+FTY_METRIC_CACHE_EXPORT int
+    rt_set_counters (rt_t *self, const char *pattern);
+
+//  Limit approximate memory used by measurements to 'bytes', evicting the least
+//  recently updated measurements when it is exceeded. 0 means no limit.
+//  A measurement counts as 2600 bytes, the fixed size of an fty_proto
+//  message, plus its names, aux and ext entries, history and rollups.
+FTY_METRIC_CACHE_EXPORT void
+    rt_set_memory_limit (rt_t *self, size_t bytes);
+
+//  Limit number of distinct measurements of one element to 'per_element' and
+//  number of distinct measurement types to 'types'. Messages which would add a
+//  measurement over a limit are dropped, updates of stored ones are not.
+//  0 means no limit.
+FTY_METRIC_CACHE_EXPORT void
+    rt_set_cardinality_limits (rt_t *self, size_t per_element, size_t types);
+
+//  Keep copy of the measurements in shared memory 'view', transfering its
+//  ownership. The stored measurements are published at once, later changes
+//  as they come. NULL stops publishing and destroys the previous view.
+FTY_METRIC_CACHE_EXPORT void
+    rt_set_view (rt_t *self, shm_view_t **view_p);
+
+//  Get ratio of updates since start which repeated the cached value, unit,
+//  aux and ext, and so only refreshed time and ttl of the cached measurement
+FTY_METRIC_CACHE_EXPORT double
+    rt_get_refresh_ratio (rt_t *self);
+
+//  Return true if 'name' contains a regex metacharacter, false if it can
+//  only be matched literally
+FTY_METRIC_CACHE_EXPORT bool
+    rt_is_pattern (const char *name);
+
 //  Purge expired data
 FTY_METRIC_CACHE_EXPORT void
     rt_purge (rt_t *self);
@@ -71,13 +230,43 @@ FTY_METRIC_CACHE_EXPORT int
 FTY_METRIC_CACHE_EXPORT void
     rt_print (rt_t *self);
 
-//  Print list devices
-FTY_METRIC_CACHE_EXPORT char *
+//  Get names of devices, each followed by newline
+//  The list is rebuilt only after the set of devices changed
+//  Does not transfer ownership, valid until the next rt_put or rt_purge
+FTY_METRIC_CACHE_EXPORT const char *
     rt_get_list_devices  (rt_t *self);
 
-//  Print info of device
-FTY_METRIC_CACHE_EXPORT char *
-    rt_get_device_info (const char *name, rt_t *self);
+//  Get summary of given element or NULL when no data
+//  Does not transfer ownership
+FTY_METRIC_CACHE_EXPORT rt_device_t *
+    rt_get_device_info (rt_t *self, const char *element);
+
+//  Sum measurements with types matching regex 'pattern' into totals of
+//  ancestors of their elements, applies to measurements stored from now on.
+//  NULL 'pattern' disables it.
+//  0 - success, -1 - invalid pattern
+FTY_METRIC_CACHE_EXPORT int
+    rt_set_topology (rt_t *self, const char *pattern);
+
+//  Set ancestors of element, the direct parent first, e.g. rack, room and
+//  datacenter. Totals of old and new ancestors are updated. NULL or empty
+//  'ancestors' removes them. The names are copied.
+FTY_METRIC_CACHE_EXPORT void
+    rt_set_parents (rt_t *self, const char *element, zlistx_t *ancestors);
+
+//  Get totals of element as hash ("measurement", rt_metric_t*) or NULL when it
+//  has none. Each total is a '<measurement>.sum' METRIC of the element with the
+//  number of summed measurements in aux 'count'.
+//  Does not transfer ownership
+FTY_METRIC_CACHE_EXPORT zhashx_t *
+    rt_get_totals (rt_t *self, const char *element);
+
+//  Drop all measurements, parents and totals of the element, e.g. when the
+//  asset was deleted
+//  0 - success, -1 - element has no measurements
+FTY_METRIC_CACHE_EXPORT int
+    rt_delete_element (rt_t *self, const char *element);
+
 //  Destroy the rt
 FTY_METRIC_CACHE_EXPORT void
     rt_destroy (rt_t **self_p);
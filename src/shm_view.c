@@ -0,0 +1,416 @@
+/*  =========================================================================
+    shm_view - copy of the records in shared memory
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    shm_view - copy of the records in shared memory
+@discuss
+    Writer side of include/fty_metric_cache_shm.h. The actor is the only
+    writer, so a record needs no lock against other writers; its sequence
+    is made odd before and even after the record changes, which lets the
+    readers in other processes detect and retry a torn copy. The table has
+    a fixed number of slots, messages which do not fit are left out.
+    Removal uses backward shift deletion, so slots are reused without
+    tombstones; the shifting is bracketed by the header counter 'moves'.
+@end
+*/
+
+#include "fty_metric_cache_classes.h"
+
+//  Structure of our class
+
+struct _shm_view_t {
+    char *name;             // of the shared memory object
+    fty_metric_cache_shm_header_t *header;
+    fty_metric_cache_shm_record_t *records;
+    size_t size;            // of the mapping
+    uint32_t slots;
+    size_t used;            // records in FTY_METRIC_CACHE_SHM_USED state
+    uint64_t skipped;       // messages left out
+};
+
+//  --------------------------------------------------------------------------
+//  Create a new shm_view
+
+shm_view_t *
+shm_view_new (const char *name, size_t slots)
+{
+    assert (name);
+    if (slots == 0 || slots > UINT32_MAX) {
+        log_error ("Shared memory view '%s' cannot have %zu slots", name, slots);
+        return NULL;
+    }
+
+    // readers of an object left behind keep their mapping until they notice
+    // it was retired and open the new one
+    shm_unlink (name);
+    int fd = shm_open (name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1) {
+        log_error ("shm_open ('%s') failed: %s", name, strerror (errno));
+        return NULL;
+    }
+    size_t size = sizeof (fty_metric_cache_shm_header_t) + slots * sizeof (fty_metric_cache_shm_record_t);
+    void *map = MAP_FAILED;
+    if (ftruncate (fd, (off_t) size) == 0)
+        map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    close (fd);
+    if (map == MAP_FAILED) {
+        log_error ("Mapping %zu bytes of '%s' failed: %s", size, name, strerror (error));
+        shm_unlink (name);
+        return NULL;
+    }
+
+    shm_view_t *self = (shm_view_t *) zmalloc (sizeof (shm_view_t));
+    assert (self);
+    self->name = strdup (name);
+    self->header = (fty_metric_cache_shm_header_t *) map;
+    self->records = (fty_metric_cache_shm_record_t *) (self->header + 1);
+    self->size = size;
+    self->slots = (uint32_t) slots;
+
+    // the object is zeroed, so all slots are FTY_METRIC_CACHE_SHM_FREE
+    self->header->version = FTY_METRIC_CACHE_SHM_VERSION;
+    self->header->slots = self->slots;
+    self->header->record_size = sizeof (fty_metric_cache_shm_record_t);
+    __atomic_store_n (&self->header->magic, FTY_METRIC_CACHE_SHM_MAGIC, __ATOMIC_RELEASE);
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the shm_view
+
+void
+shm_view_destroy (shm_view_t **self_p)
+{
+    if (!self_p || !*self_p)
+        return;
+    shm_view_t *self = *self_p;
+    __atomic_store_n (&self->header->magic, 0, __ATOMIC_RELEASE);
+    munmap (self->header, self->size);
+    shm_unlink (self->name);
+    zstr_free (&self->name);
+    free (self);
+    *self_p = NULL;
+}
+
+//  Find slot of (element, type), or the slot to put it in when 'found' is
+//  false; -1 when there is neither
+
+static int64_t
+s_find (shm_view_t *self, const char *element, const char *type, bool *found)
+{
+    *found = false;
+    uint32_t slot = fty_metric_cache_shm_slot (element, type, self->slots);
+    for (uint32_t probe = 0; probe < self->slots; probe++) {
+        uint32_t index = (slot + probe) % self->slots;
+        fty_metric_cache_shm_record_t *record = &self->records [index];
+        if (record->state == FTY_METRIC_CACHE_SHM_FREE)
+            return index;
+        if (streq (record->element, element) && streq (record->type, type)) {
+            *found = true;
+            return index;
+        }
+    }
+    return -1;
+}
+
+//  Make the record odd while it changes
+
+static void
+s_write_begin (fty_metric_cache_shm_record_t *record)
+{
+    __atomic_store_n (&record->sequence, record->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+static void
+s_write_end (fty_metric_cache_shm_record_t *record)
+{
+    __atomic_store_n (&record->sequence, record->sequence + 1, __ATOMIC_RELEASE);
+}
+
+//  --------------------------------------------------------------------------
+//  Publish the message
+
+int
+shm_view_put (shm_view_t *self, fty_proto_t *message)
+{
+    assert (self);
+    assert (message);
+
+    const char *element = fty_proto_name (message);
+    const char *type = fty_proto_type (message);
+    const char *value = fty_proto_value (message);
+    const char *unit = fty_proto_unit (message);
+    if (!element || !type || !value || !unit
+    ||  strlen (element) >= FTY_METRIC_CACHE_SHM_ELEMENT_SIZE
+    ||  strlen (type) >= FTY_METRIC_CACHE_SHM_TYPE_SIZE
+    ||  strlen (value) >= FTY_METRIC_CACHE_SHM_VALUE_SIZE
+    ||  strlen (unit) >= FTY_METRIC_CACHE_SHM_UNIT_SIZE) {
+        log_debug ("Metric %s@%s does not fit shared memory view '%s'", type, element, self->name);
+        if (element && type)
+            shm_view_remove (self, element, type);
+        self->skipped++;
+        return -1;
+    }
+
+    bool found;
+    int64_t index = s_find (self, element, type, &found);
+    if (index == -1) {
+        if (self->skipped++ == 0)
+            log_warning ("Shared memory view '%s' is full, %" PRIu32 " slots, metrics are left out",
+                    self->name, self->slots);
+        return -1;
+    }
+
+    fty_metric_cache_shm_record_t *record = &self->records [index];
+    s_write_begin (record);
+    if (!found) {
+        memset (record->element, 0, sizeof (record->element));
+        memset (record->type, 0, sizeof (record->type));
+        strcpy (record->element, element);
+        strcpy (record->type, type);
+        record->state = FTY_METRIC_CACHE_SHM_USED;
+        self->used++;
+    }
+    memset (record->value, 0, sizeof (record->value));
+    memset (record->unit, 0, sizeof (record->unit));
+    strcpy (record->value, value);
+    strcpy (record->unit, unit);
+    record->time = fty_proto_time (message);
+    record->ttl = fty_proto_ttl (message);
+    s_write_end (record);
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Remove record of (element, type)
+
+void
+shm_view_remove (shm_view_t *self, const char *element, const char *type)
+{
+    assert (self);
+    assert (element);
+    assert (type);
+
+    bool found;
+    int64_t index = s_find (self, element, type, &found);
+    if (!found)
+        return;
+
+    // readers probing meanwhile may miss a record shifted behind them, an
+    // odd 'moves' tells them to look again
+    __atomic_store_n (&self->header->moves, self->header->moves + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    uint32_t hole = (uint32_t) index;
+    s_write_begin (&self->records [hole]);
+    self->records [hole].state = FTY_METRIC_CACHE_SHM_FREE;
+    s_write_end (&self->records [hole]);
+
+    // backward shift: move up every record of the run after the hole whose
+    // home slot does not lie between the hole and the record itself
+    const size_t offset = offsetof (fty_metric_cache_shm_record_t, state);
+    for (uint32_t next = (hole + 1) % self->slots; next != hole; next = (next + 1) % self->slots) {
+        fty_metric_cache_shm_record_t *record = &self->records [next];
+        if (record->state == FTY_METRIC_CACHE_SHM_FREE)
+            break;
+        uint32_t home = fty_metric_cache_shm_slot (record->element, record->type, self->slots);
+        if ((next + self->slots - home) % self->slots < (next + self->slots - hole) % self->slots)
+            continue;
+        fty_metric_cache_shm_record_t *target = &self->records [hole];
+        s_write_begin (target);
+        memcpy ((char *) target + offset, (char *) record + offset, sizeof (fty_metric_cache_shm_record_t) - offset);
+        s_write_end (target);
+        s_write_begin (record);
+        record->state = FTY_METRIC_CACHE_SHM_FREE;
+        s_write_end (record);
+        hole = next;
+    }
+
+    __atomic_store_n (&self->header->moves, self->header->moves + 1, __ATOMIC_RELEASE);
+    self->used--;
+}
+
+//  --------------------------------------------------------------------------
+//  Get number of published records
+
+size_t
+shm_view_size (shm_view_t *self)
+{
+    assert (self);
+    return self->used;
+}
+
+//  --------------------------------------------------------------------------
+//  Get number of messages left out since start
+
+uint64_t
+shm_view_skipped (shm_view_t *self)
+{
+    assert (self);
+    return self->skipped;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+static fty_proto_t *
+s_metric (const char *element, const char *type, const char *value)
+{
+    fty_proto_t *metric = fty_proto_new (FTY_PROTO_METRIC);
+    fty_proto_set_name (metric, "%s", element);
+    fty_proto_set_type (metric, "%s", type);
+    fty_proto_set_value (metric, "%s", value);
+    fty_proto_set_unit (metric, "%s", "W");
+    fty_proto_set_time (metric, 1000);
+    fty_proto_set_ttl (metric, 60);
+    return metric;
+}
+
+void
+shm_view_test (bool verbose)
+{
+    ftylog_setInstance ("shm_view", "");
+
+    if (verbose)
+        ftylog_setVeboseMode (ftylog_getInstance ());
+
+    //  @selftest
+    char *name = zsys_sprintf ("/fty-metric-cache-test-%d", (int) getpid ());
+    // readers do not find an object which is not there
+    fty_metric_cache_shm_t reader;
+    assert (fty_metric_cache_shm_open (&reader, name) == -1);
+
+    shm_view_t *self = shm_view_new (name, 4);
+    assert (self);
+    assert (fty_metric_cache_shm_open (&reader, name) == 0);
+    assert (reader.header->slots == 4);
+
+    fty_metric_cache_shm_record_t record;
+    assert (fty_metric_cache_shm_get (&reader, "ups-1", "realpower.default", &record) == -1);
+
+    fty_proto_t *metric = s_metric ("ups-1", "realpower.default", "100");
+    assert (shm_view_put (self, metric) == 0);
+    fty_proto_destroy (&metric);
+    assert (fty_metric_cache_shm_get (&reader, "ups-1", "realpower.default", &record) == 0);
+    assert (streq (record.value, "100"));
+    assert (streq (record.unit, "W"));
+    assert (record.time == 1000);
+    assert (record.ttl == 60);
+    uint64_t sequence = record.sequence;
+    assert ((sequence & 1) == 0);
+
+    // update in place
+    metric = s_metric ("ups-1", "realpower.default", "200");
+    assert (shm_view_put (self, metric) == 0);
+    fty_proto_destroy (&metric);
+    assert (fty_metric_cache_shm_get (&reader, "ups-1", "realpower.default", &record) == 0);
+    assert (streq (record.value, "200"));
+    assert (record.sequence == sequence + 2);
+    assert (shm_view_size (self) == 1);
+
+    // fill the table, the fifth record has no room
+    for (int i = 2; i <= 5; i++) {
+        char *element = zsys_sprintf ("ups-%d", i);
+        metric = s_metric (element, "realpower.default", "1");
+        assert (shm_view_put (self, metric) == (i == 5 ? -1 : 0));
+        fty_proto_destroy (&metric);
+        zstr_free (&element);
+    }
+    assert (shm_view_size (self) == 4);
+    assert (shm_view_skipped (self) == 1);
+    assert (fty_metric_cache_shm_get (&reader, "ups-5", "realpower.default", &record) == -1);
+
+    // records shifted back on removal are still found, the slot is reused
+    shm_view_remove (self, "ups-1", "realpower.default");
+    assert (shm_view_size (self) == 3);
+    assert (fty_metric_cache_shm_get (&reader, "ups-1", "realpower.default", &record) == -1);
+    for (int i = 2; i <= 4; i++) {
+        char *element = zsys_sprintf ("ups-%d", i);
+        assert (fty_metric_cache_shm_get (&reader, element, "realpower.default", &record) == 0);
+        zstr_free (&element);
+    }
+    metric = s_metric ("ups-5", "realpower.default", "5");
+    assert (shm_view_put (self, metric) == 0);
+    fty_proto_destroy (&metric);
+    assert (fty_metric_cache_shm_get (&reader, "ups-5", "realpower.default", &record) == 0);
+    assert (streq (record.value, "5"));
+
+    // value which does not fit drops the previous one
+    metric = s_metric ("ups-5", "realpower.default", "12345678901234567890123456789012345");
+    assert (shm_view_put (self, metric) == -1);
+    fty_proto_destroy (&metric);
+    assert (fty_metric_cache_shm_get (&reader, "ups-5", "realpower.default", &record) == -1);
+
+    // removals leave no tombstones, churn does not use up the table
+    for (int i = 0; i < 100; i++) {
+        char *element = zsys_sprintf ("epdu-%d", i);
+        metric = s_metric (element, "realpower.default", "1");
+        assert (shm_view_put (self, metric) == 0);
+        fty_proto_destroy (&metric);
+        assert (fty_metric_cache_shm_get (&reader, element, "realpower.default", &record) == 0);
+        shm_view_remove (self, element, "realpower.default");
+        assert (fty_metric_cache_shm_get (&reader, element, "realpower.default", &record) == -1);
+        for (int j = 2; j <= 4; j++) {
+            char *ups = zsys_sprintf ("ups-%d", j);
+            assert (fty_metric_cache_shm_get (&reader, ups, "realpower.default", &record) == 0);
+            zstr_free (&ups);
+        }
+        zstr_free (&element);
+    }
+    assert (shm_view_size (self) == 3);
+    for (int i = 2; i <= 4; i++) {
+        char *element = zsys_sprintf ("ups-%d", i);
+        shm_view_remove (self, element, "realpower.default");
+        zstr_free (&element);
+    }
+    assert (shm_view_size (self) == 0);
+    assert ((reader.header->moves & 1) == 0);
+    for (uint32_t i = 0; i < reader.header->slots; i++)
+        assert (reader.records [i].state == FTY_METRIC_CACHE_SHM_FREE);
+    for (int i = 0; i < 4; i++) {
+        char *element = zsys_sprintf ("sensor-%d", i);
+        metric = s_metric (element, "temperature", "20");
+        assert (shm_view_put (self, metric) == 0);
+        fty_proto_destroy (&metric);
+        zstr_free (&element);
+    }
+    for (int i = 0; i < 4; i++) {
+        char *element = zsys_sprintf ("sensor-%d", i);
+        assert (fty_metric_cache_shm_get (&reader, element, "temperature", &record) == 0);
+        zstr_free (&element);
+    }
+
+    // readers notice the agent stopped
+    shm_view_destroy (&self);
+    shm_view_destroy (&self);
+    assert (fty_metric_cache_shm_get (&reader, "ups-2", "realpower.default", &record) == -2);
+    fty_metric_cache_shm_close (&reader);
+    assert (fty_metric_cache_shm_open (&reader, name) == -1);
+
+    // a view needs slots
+    assert (shm_view_new (name, 0) == NULL);
+    zstr_free (&name);
+    //  @end
+    log_info ("OK\n");
+}
@@ -0,0 +1,70 @@
+/*  =========================================================================
+    shm_view - copy of the records in shared memory
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SHM_VIEW_H_INCLUDED
+#define SHM_VIEW_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+
+//  Create shared memory object 'name' (like "/fty-metric-cache") with room
+//  for 'slots' records, replacing an object of the same name left behind.
+//  Returns NULL when it cannot be created.
+FTY_METRIC_CACHE_EXPORT shm_view_t *
+    shm_view_new (const char *name, size_t slots);
+
+//  Publish the message as the latest record of its (element, type)
+//  Returns 0 on success, -1 when it was left out because a name, the value
+//  or the unit is too long or there is no free slot; a previous record of
+//  the same (element, type) is removed then
+FTY_METRIC_CACHE_EXPORT int
+    shm_view_put (shm_view_t *self, fty_proto_t *message);
+
+//  Remove record of (element, type), if any
+FTY_METRIC_CACHE_EXPORT void
+    shm_view_remove (shm_view_t *self, const char *element, const char *type);
+
+//  Get number of published records
+FTY_METRIC_CACHE_EXPORT size_t
+    shm_view_size (shm_view_t *self);
+
+//  Get number of messages left out since start
+FTY_METRIC_CACHE_EXPORT uint64_t
+    shm_view_skipped (shm_view_t *self);
+
+//  Retire the object, so that readers know to reopen it, and destroy the view
+FTY_METRIC_CACHE_EXPORT void
+    shm_view_destroy (shm_view_t **self_p);
+
+//  Self test of this class
+FTY_METRIC_CACHE_PRIVATE void
+    shm_view_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif